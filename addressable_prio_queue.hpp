@@ -0,0 +1,450 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_ADDRESSABLE_PRIO_QUEUE_HPP
+#define ROLLBEAR_ADDRESSABLE_PRIO_QUEUE_HPP
+
+#include "prio_queue.hpp"
+
+#ifdef __GNUC__
+#define rollbear_prio_q_likely(x)       __builtin_expect(!!(x), 1)
+#define rollbear_prio_q_unlikely(x)     __builtin_expect(!!(x), 0)
+#else
+  #define rollbear_prio_q_likely(x) x
+  #define rollbear_prio_q_unlikely(x) x
+#endif
+
+namespace rollbear
+{
+
+// A B-heap priority queue where push() returns a handle that stays valid
+// until the element is popped or erased, regardless of how the element moves
+// in the heap. The handle can be used to change the priority of, or remove,
+// any element in O(log n).
+//
+// Every move in the heap also updates a handle -> position table, so this
+// is slower than prio_queue<> when the extra operations are not needed.
+template <std::size_t block_size, typename T, typename V,
+                                  typename Compare = std::less<T>,
+                                  typename Allocator = std::allocator<T>>
+class addressable_prio_queue
+  : private Compare
+  , private prio_q_internal::payload<
+      block_size, V, typename prio_q_internal::payload_allocator<Allocator, V>::type>
+{
+  using address = prio_q_internal::heap_heap_addressing<block_size>;
+  using P = prio_q_internal::payload<
+    block_size, V, typename prio_q_internal::payload_allocator<Allocator, V>::type>;
+  using size_alloc = typename std::allocator_traits<Allocator>::template rebind_alloc<std::size_t>;
+public:
+  using value_type = T;
+  using payload_type = V;
+  using handle = std::size_t;
+
+  addressable_prio_queue(Compare const &compare = Compare()) : Compare(compare) { }
+  // The payloads are allocated from a copy of a, rebound to V.
+  explicit addressable_prio_queue(Compare const &compare, Allocator const &a)
+    : Compare(compare)
+    , P(typename P::allocator_type(a))
+    , m_storage(a)
+    , m_handles(size_alloc(a))
+    , m_positions(size_alloc(a)) { }
+
+  template <typename U, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value, handle>
+  push(U &&u);
+
+  template <typename U, typename X>
+  std::enable_if_t<!std::is_same<X, void>::value, handle>
+  push(U &&key, X &&value);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, value_type const &>
+  top() const noexcept;
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+  top() noexcept;
+
+  handle top_handle() const noexcept;
+
+  void pop();
+
+  void reschedule_top(T t);
+
+  void update(handle h, T t);
+
+  void erase(handle h);
+
+  T const &key(handle h) const noexcept;
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, U &>
+  value(handle h) noexcept;
+
+  bool empty() const noexcept;
+
+  std::size_t size() const noexcept;
+private:
+  static constexpr handle no_handle = ~handle{};
+
+  handle allocate_handle(std::size_t idx);
+  void   release_handle(handle h) noexcept;
+
+  // Whether h is from push() and not yet erased or popped. A released
+  // handle holds the next free one, which is never an index mapping back
+  // to it.
+  bool   is_live(handle h) const noexcept;
+
+  template <typename U>
+  handle push_key(U &&key);
+
+  template <typename X>
+  void place(std::size_t idx, T t, X &&val, handle h);
+
+  template <typename X>
+  void sift_up(std::size_t idx, T t, X &&val, handle h);
+
+  template <typename X>
+  void sift_down(std::size_t idx, T t, X &&val, handle h);
+
+  void move(std::size_t from, std::size_t to);
+
+  bool sorts_before(value_type const &lv, value_type const &rv) const noexcept;
+
+  prio_q_internal::skip_vector<T, block_size, Allocator>           m_storage;
+  prio_q_internal::skip_vector<handle, block_size, size_alloc>     m_handles;
+  std::vector<std::size_t, size_alloc>                             m_positions;
+  handle                                                           m_free = no_handle;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+constexpr typename addressable_prio_queue<block_size, T, V, Compare, Allocator>::handle
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::no_handle;
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value,
+                 typename addressable_prio_queue<block_size, T, V, Compare, Allocator>::handle>
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+push(U &&u)
+{
+  return push_key(std::forward<U>(u));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value,
+                 typename addressable_prio_queue<block_size, T, V, Compare, Allocator>::handle>
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+push(U &&key, X &&value)
+{
+  P::push_back(std::forward<X>(value));
+  return push_key(std::forward<U>(key));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+typename addressable_prio_queue<block_size, T, V, Compare, Allocator>::handle
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+push_key(U &&key)
+{
+  auto idx = m_storage.push_back(std::forward<U>(key));
+  auto h   = allocate_handle(idx);
+  m_handles.push_back(h);
+  auto val = std::move(P::back());
+  sift_up(idx, std::move(m_storage[idx]), std::move(val), h);
+  return h;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value, T const &>
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+top()
+const
+noexcept
+{
+  assert(!empty());
+  return m_storage[1];
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+top()
+noexcept
+{
+  assert(!empty());
+  return { m_storage[1], P::top() };
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+typename addressable_prio_queue<block_size, T, V, Compare, Allocator>::handle
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+top_handle()
+const
+noexcept
+{
+  assert(!empty());
+  return m_handles[1];
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+pop()
+{
+  assert(!empty());
+  erase(m_handles[1]);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+reschedule_top(T t)
+{
+  assert(!empty());
+  update(m_handles[1], std::move(t));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+update(handle h, T t)
+{
+  assert(is_live(h));
+  auto const idx = m_positions[h];
+  auto       val = std::move(P::get(idx));
+  place(idx, std::move(t), std::move(val), h);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+erase(handle h)
+{
+  assert(is_live(h));
+  auto const idx      = m_positions[h];
+  auto const last_idx = m_storage.size() - 1;
+  release_handle(h);
+  if (rollbear_prio_q_likely(idx != last_idx))
+  {
+    auto last     = std::move(m_storage.back());
+    auto last_val = std::move(P::back());
+    auto last_h   = m_handles.back();
+    m_storage.pop_back();
+    P::pop_back();
+    m_handles.pop_back();
+    place(idx, std::move(last), std::move(last_val), last_h);
+    return;
+  }
+  m_storage.pop_back();
+  P::pop_back();
+  m_handles.pop_back();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+T const &
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+key(handle h)
+const
+noexcept
+{
+  assert(is_live(h));
+  return m_storage[m_positions[h]];
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, U &>
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+value(handle h)
+noexcept
+{
+  assert(is_live(h));
+  return P::get(m_positions[h]);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+bool
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+empty()
+const
+noexcept
+{
+  return m_storage.empty();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+std::size_t
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+size()
+const
+noexcept
+{
+  return m_storage.size()
+      - (m_storage.size() + address::block_size - 1) / address::block_size;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+typename addressable_prio_queue<block_size, T, V, Compare, Allocator>::handle
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+allocate_handle(std::size_t idx)
+{
+  if (m_free == no_handle)
+  {
+    m_positions.push_back(idx);
+    return m_positions.size() - 1;
+  }
+  auto h = m_free;
+  m_free = m_positions[h];
+  m_positions[h] = idx;
+  return h;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+release_handle(handle h)
+noexcept
+{
+  m_positions[h] = m_free;
+  m_free = h;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+bool
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+is_live(handle h)
+const
+noexcept
+{
+  if (h >= m_positions.size()) return false;
+  auto const idx = m_positions[h];
+  return idx < m_storage.size()
+      && address::block_offset(idx) != 0
+      && m_handles[idx] == h;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename X>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+place(std::size_t idx, T t, X &&val, handle h)
+{
+  if (idx != 1 && sorts_before(t, m_storage[address::parent_of(idx)]))
+  {
+    sift_up(idx, std::move(t), std::forward<X>(val), h);
+  }
+  else
+  {
+    sift_down(idx, std::move(t), std::forward<X>(val), h);
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename X>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+sift_up(std::size_t idx, T t, X &&val, handle h)
+{
+  while (rollbear_prio_q_likely(idx != 1U))
+  {
+    auto parent = address::parent_of(idx);
+    if (rollbear_prio_q_likely(!sorts_before(t, m_storage[parent]))) break;
+    move(parent, idx);
+    idx = parent;
+  }
+  m_storage[idx] = std::move(t);
+  P::store(idx, std::forward<X>(val));
+  m_handles[idx] = h;
+  m_positions[h] = idx;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename X>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+sift_down(std::size_t idx, T t, X &&val, handle h)
+{
+  auto const last_idx = m_storage.size() - 1;
+  for (;;)
+  {
+    auto lc = address::child_of(idx);
+    if (rollbear_prio_q_unlikely(lc > last_idx)) break;
+    auto rc   = address::next_sibling(lc);
+    auto i    = rc <= last_idx && !sorts_before(m_storage[lc], m_storage[rc]);
+    auto next = i ? rc : lc;
+    if (!sorts_before(m_storage[next], t)) break;
+    move(next, idx);
+    idx = next;
+  }
+  m_storage[idx] = std::move(t);
+  P::store(idx, std::forward<X>(val));
+  m_handles[idx] = h;
+  m_positions[h] = idx;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+move(std::size_t from, std::size_t to)
+{
+  m_storage[to] = std::move(m_storage[from]);
+  P::move(from, to);
+  auto const h = m_handles[from];
+  m_handles[to] = h;
+  m_positions[h] = to;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+bool
+addressable_prio_queue<block_size, T, V, Compare, Allocator>::
+sorts_before(value_type const &lv, value_type const &rv)
+const
+noexcept
+{
+  Compare const &c = *this;
+  return c(lv, rv);
+}
+
+} // namespace rollbear
+
+#undef rollbear_prio_q_likely
+#undef rollbear_prio_q_unlikely
+
+#endif //ROLLBEAR_ADDRESSABLE_PRIO_QUEUE_HPP
@@ -0,0 +1,193 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+// Measures the best block size of prio_queue<> for a range of key and payload
+// sizes on the machine it runs on, and writes a header for prio_queue_auto<>
+// to use them. Build with optimization, and run on an otherwise idle machine:
+//
+//   g++ -std=c++14 -O2 autotune.cpp -o autotune
+//   ./autotune prio_queue_tuning.hpp [queue size]
+//
+// and include prio_queue_tuning.hpp before prio_queue.hpp.
+
+#include "prio_queue.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <std::size_t size>
+struct payload
+{
+  payload(std::uint64_t i = 0) { std::memcpy(bytes, &i, std::min(size, sizeof(i))); }
+  char bytes[size];
+};
+
+template <typename T, typename V>
+struct push_random
+{
+  template <typename Q>
+  static void push(Q &q, std::uint64_t k) { q.push(T(k), V(k)); }
+};
+
+template <typename T>
+struct push_random<T, void>
+{
+  template <typename Q>
+  static void push(Q &q, std::uint64_t k) { q.push(T(k)); }
+};
+
+template <typename Q>
+std::enable_if_t<std::is_void<typename Q::payload_type>::value, std::uint64_t>
+top_key(Q &q) { return q.top(); }
+
+template <typename Q>
+std::enable_if_t<!std::is_void<typename Q::payload_type>::value, std::uint64_t>
+top_key(Q &q) { return q.top().first; }
+
+// The hold model, popping the top and pushing it back a random distance
+// later, on a queue of size elements. Returns the best of a few runs.
+template <std::size_t block_size, typename T, typename V>
+double measure_hold(std::size_t size, std::size_t ops)
+{
+  using Q = rollbear::prio_queue<block_size, T, V>;
+  double best = 0;
+  for (int run = 0; run != 3; ++run)
+  {
+    std::minstd_rand gen(4711);
+    Q q;
+    for (std::size_t i = 0; i != size; ++i)
+    {
+      push_random<T, V>::push(q, gen() >> 1);
+    }
+    auto const begin = Clock::now();
+    for (std::size_t i = 0; i != ops; ++i)
+    {
+      auto const k = top_key(q);
+      q.pop();
+      push_random<T, V>::push(q, k + (gen() >> 12));
+    }
+    std::chrono::duration<double> const t = Clock::now() - begin;
+    if (run == 0 || t.count() < best) best = t.count();
+  }
+  return best;
+}
+
+struct result
+{
+  std::size_t key_size;
+  std::size_t payload_size;
+  std::size_t block_size;
+};
+
+template <typename T, typename V>
+result tune(std::size_t size)
+{
+  using M = double (*)(std::size_t, std::size_t);
+  static const std::pair<std::size_t, M> candidates[] = {
+    { 4,   &measure_hold<4,   T, V> },
+    { 8,   &measure_hold<8,   T, V> },
+    { 16,  &measure_hold<16,  T, V> },
+    { 32,  &measure_hold<32,  T, V> },
+    { 64,  &measure_hold<64,  T, V> },
+    { 128, &measure_hold<128, T, V> },
+    { 256, &measure_hold<256, T, V> },
+  };
+  auto const payload_size = rollbear::prio_q_internal::payload_size<V>::value;
+  std::cout << sizeof(T) << " byte keys, " << payload_size << " byte payloads:";
+  std::size_t best_block = 0;
+  double best_time = 0;
+  for (auto const &c : candidates)
+  {
+    auto const t = c.second(size, size / 4);
+    std::cout << ' ' << c.first << '=' << static_cast<long>(t * 1e6) << "us"
+              << std::flush;
+    if (best_block == 0 || t < best_time)
+    {
+      best_block = c.first;
+      best_time = t;
+    }
+  }
+  std::cout << " -> " << best_block << '\n';
+  return { sizeof(T), payload_size, best_block };
+}
+
+template <typename T>
+void tune_key(std::vector<result> &results, std::size_t size)
+{
+  results.push_back(tune<T, void>(size));
+  results.push_back(tune<T, payload<4>>(size));
+  results.push_back(tune<T, payload<8>>(size));
+  results.push_back(tune<T, payload<16>>(size));
+  results.push_back(tune<T, payload<32>>(size));
+  results.push_back(tune<T, payload<64>>(size));
+}
+
+long cache_line_size()
+{
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+  auto const line = ::sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+  if (line > 0) return line;
+#endif
+  return 64;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 3)
+  {
+    std::cerr << "usage: " << argv[0] << " header [queue size]\n";
+    return 1;
+  }
+  // Far larger than the caches by default, which is where the block size
+  // matters.
+  std::size_t const size = argc == 3 ? std::strtoul(argv[2], nullptr, 10)
+                                     : 2000000;
+
+  std::vector<result> results;
+  tune_key<std::uint32_t>(results, size);
+  tune_key<std::uint64_t>(results, size);
+
+  std::ofstream out(argv[1]);
+  out << "// Written by autotune for a queue of " << size << " elements.\n"
+      << "#ifndef ROLLBEAR_PRIO_QUEUE_TUNING_HPP\n"
+      << "#define ROLLBEAR_PRIO_QUEUE_TUNING_HPP\n"
+      << "\n"
+      << "#define ROLLBEAR_PRIO_QUEUE_CACHE_LINE_SIZE " << cache_line_size() << '\n'
+      << "#define ROLLBEAR_PRIO_QUEUE_BLOCK_SIZES";
+  char const *separator = " \\\n  ";
+  for (auto const &r : results)
+  {
+    out << separator << "{ " << r.key_size << ", " << r.payload_size << ", "
+        << r.block_size << " }";
+    separator = ", \\\n  ";
+  }
+  out << "\n\n#endif //ROLLBEAR_PRIO_QUEUE_TUNING_HPP\n";
+  if (!out)
+  {
+    std::cerr << "failed to write " << argv[1] << '\n';
+    return 1;
+  }
+}
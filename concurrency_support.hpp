@@ -0,0 +1,108 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_CONCURRENCY_SUPPORT_HPP
+#define ROLLBEAR_CONCURRENCY_SUPPORT_HPP
+
+#include <atomic>
+#include <thread>
+#include <random>
+#include <memory>
+#include <functional>
+#include <cstddef>
+
+namespace rollbear
+{
+
+namespace prio_q_internal
+{
+static const constexpr std::size_t cache_line_size = 64;
+
+inline
+std::minstd_rand &thread_rng()
+{
+  static thread_local std::minstd_rand rng(
+      static_cast<std::minstd_rand::result_type>(
+          std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1U));
+  return rng;
+}
+
+// A small number, unique for each thread that asks for one.
+inline
+std::size_t thread_index()
+{
+  static std::atomic<std::size_t> next{0};
+  static thread_local std::size_t index = next++;
+  return index;
+}
+
+// An array of objects, each starting on a cache line of its own, that is
+// never resized. Every object is constructed from the same args.
+template <typename T>
+class cache_aligned_array
+{
+  struct alignas(cache_line_size) element
+  {
+    template <typename ... Args>
+    explicit element(Args const & ... args) : t(args...) { }
+    T t;
+  };
+public:
+  template <typename ... Args>
+  explicit cache_aligned_array(std::size_t size, Args const & ... args)
+    : m_buffer(new char[size * sizeof(element) + cache_line_size])
+    , m_size(size)
+  {
+    void *p = m_buffer.get();
+    auto space = size * sizeof(element) + cache_line_size;
+    m_elements = static_cast<element*>(std::align(cache_line_size,
+                                                  size * sizeof(element),
+                                                  p,
+                                                  space));
+    std::size_t i = 0;
+    try
+    {
+      for (; i != size; ++i)
+      {
+        new (m_elements + i) element(args...);
+      }
+    }
+    catch (...)
+    {
+      while (i--) m_elements[i].~element();
+      throw;
+    }
+  }
+  ~cache_aligned_array()
+  {
+    for (std::size_t i = 0; i != m_size; ++i)
+    {
+      m_elements[i].~element();
+    }
+  }
+  cache_aligned_array(cache_aligned_array const&) = delete;
+  cache_aligned_array& operator=(cache_aligned_array const&) = delete;
+
+  T       &operator[](std::size_t idx) noexcept { return m_elements[idx].t; }
+  T const &operator[](std::size_t idx) const noexcept { return m_elements[idx].t; }
+  std::size_t size() const noexcept { return m_size; }
+private:
+  std::unique_ptr<char[]> m_buffer;
+  element                *m_elements;
+  std::size_t             m_size;
+};
+} // namespace prio_q_internal
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_CONCURRENCY_SUPPORT_HPP
@@ -0,0 +1,608 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_EXTERNAL_PRIO_QUEUE_HPP
+#define ROLLBEAR_EXTERNAL_PRIO_QUEUE_HPP
+
+#include "prio_queue.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rollbear
+{
+namespace prio_q_internal
+{
+
+// How an element is stored in a run file: the bytes of the key, followed by
+// the bytes of the payload, if any.
+template <typename T, typename V>
+struct run_record
+{
+  static constexpr std::size_t size = sizeof(T) + sizeof(V);
+  static void encode(unsigned char *p, std::pair<T, V> const &e) noexcept
+  {
+    std::memcpy(p, &e.first, sizeof(T));
+    std::memcpy(p + sizeof(T), &e.second, sizeof(V));
+  }
+  static std::pair<T, V> decode(unsigned char const *p) noexcept
+  {
+    return { snapshot_value<T>(p), snapshot_value<V>(p + sizeof(T)) };
+  }
+};
+
+template <typename T>
+struct run_record<T, void>
+{
+  static constexpr std::size_t size = sizeof(T);
+  static void encode(unsigned char *p, T const &t) noexcept
+  {
+    std::memcpy(p, &t, sizeof(T));
+  }
+  static T decode(unsigned char const *p) noexcept
+  {
+    return snapshot_value<T>(p);
+  }
+};
+
+// A file in the queue's directory, that is removed when closed.
+class run_file
+{
+public:
+  run_file() = default;
+  explicit run_file(std::string path);
+  run_file(run_file &&f) noexcept;
+  run_file &operator=(run_file &&f) noexcept;
+  ~run_file() { close(); }
+
+  explicit operator bool() const noexcept { return m_file != nullptr; }
+
+  void write(unsigned char const *p, std::size_t n);
+  void read(unsigned char *p, std::size_t n);
+  void rewind();
+  void close() noexcept;
+private:
+  [[noreturn]] void fail(char const *what) const;
+
+  std::FILE   *m_file = nullptr;
+  std::string  m_path;
+};
+
+inline
+run_file::run_file(std::string path)
+  : m_file(std::fopen(path.c_str(), "w+b"))
+  , m_path(std::move(path))
+{
+  if (!m_file) fail("cannot create");
+  // The runs are read and written in whole blocks of their own, so the
+  // stdio buffer would only add a copy.
+  std::setvbuf(m_file, nullptr, _IONBF, 0);
+}
+
+inline
+run_file::run_file(run_file &&f) noexcept
+  : m_file(f.m_file)
+  , m_path(std::move(f.m_path))
+{
+  f.m_file = nullptr;
+}
+
+inline
+run_file &
+run_file::operator=(run_file &&f) noexcept
+{
+  if (this != &f)
+  {
+    close();
+    m_file = f.m_file;
+    m_path = std::move(f.m_path);
+    f.m_file = nullptr;
+  }
+  return *this;
+}
+
+inline
+void
+run_file::write(unsigned char const *p, std::size_t n)
+{
+  if (std::fwrite(p, 1, n, m_file) != n) fail("cannot write");
+}
+
+inline
+void
+run_file::read(unsigned char *p, std::size_t n)
+{
+  if (std::fread(p, 1, n, m_file) != n) fail("cannot read");
+}
+
+inline
+void
+run_file::rewind()
+{
+  if (std::fflush(m_file) != 0 || std::fseek(m_file, 0, SEEK_SET) != 0)
+  {
+    fail("cannot rewind");
+  }
+}
+
+inline
+void
+run_file::close() noexcept
+{
+  if (m_file)
+  {
+    std::fclose(m_file);
+    std::remove(m_path.c_str());
+    m_file = nullptr;
+  }
+}
+
+inline
+void
+run_file::fail(char const *what) const
+{
+  throw std::runtime_error(std::string("external_prio_queue: ") + what + " "
+                           + m_path);
+}
+
+} // namespace prio_q_internal
+
+// A priority queue for more elements than fit in memory, of trivially
+// copyable keys and payloads. New elements go to a prio_queue<> in memory,
+// and when it holds its share of the memory budget, it is drained, in order,
+// to a sorted run in a file in the directory given. The runs are merged
+// lazily, by pop(), through a small prio_queue<> over the first element of
+// each run, and are read and written sequentially in blocks of
+// io_block_size bytes, one of which is in memory per run. When the runs
+// would need more blocks than the budget allows, the smaller half of them
+// are first merged to one, so that, as in a merge sort, every element is
+// rewritten a logarithmic number of times. The files are removed when their
+// runs are exhausted, and by clear() and the destructor.
+//
+// Half of the memory budget is for the prio_queue<> of new elements, which
+// is reserved by the constructor, and half for the blocks of the runs, which
+// are released as the runs are exhausted. An I/O error throws std::runtime_error,
+// and loses the elements already drained to the run being written, whose
+// file is removed. The rest stay in the queue.
+template <std::size_t block_size, typename T, typename V,
+                                  typename Compare = std::less<T>>
+class external_prio_queue : private Compare
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "external_prio_queue requires trivially copyable keys");
+  static_assert(prio_q_internal::snapshot_copyable<V>::value,
+                "external_prio_queue requires trivially copyable payloads");
+  using element = prio_q_internal::element<T, V>;
+  using record = prio_q_internal::run_record<T, V>;
+  using run_no = std::uint32_t;
+  using heads_queue = prio_queue<block_size, T, run_no, Compare>;
+public:
+  explicit external_prio_queue(std::string directory,
+                               std::size_t memory_budget = std::size_t(256) << 20,
+                               std::size_t io_block_size = std::size_t(1) << 20,
+                               Compare const &compare = Compare());
+
+  using value_type = T;
+  using payload_type = V;
+
+  template <typename U, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  push(U &&u);
+
+  template <typename U, typename X>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  push(U &&key, X &&value);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, value_type const &>
+  top() const noexcept;
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+  top() noexcept;
+
+  void pop();
+
+  bool empty() const noexcept;
+
+  std::size_t size() const noexcept;
+
+  // The number of runs in files, with elements left to pop.
+  std::size_t runs() const noexcept;
+
+  void clear() noexcept;
+private:
+  struct run
+  {
+    prio_q_internal::run_file           file;
+    std::uint64_t                       on_disk = 0;
+    std::vector<typename element::type> block;
+    std::size_t                         pos = 0;
+  };
+
+  // Writes the new elements to a run when they fill their share of the
+  // memory budget.
+  void make_room();
+
+  bool top_in_runs() const noexcept;
+
+  // Pops the top of the run first in heads.
+  void pop_run(heads_queue &heads);
+
+  // Drains q, in order, to a new run.
+  template <typename Q>
+  void write_run(Q &q);
+
+  // Reads the next block of r, if any, and puts its first key in heads.
+  void fill(run_no r, heads_queue &heads);
+
+  // Merges the runs with the fewest elements left to one.
+  void merge_runs();
+
+  std::uint64_t remaining(run_no r) const noexcept
+  {
+    return m_runs[r].on_disk + (m_runs[r].block.size() - m_runs[r].pos);
+  }
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, T const &>
+  insert_key() const noexcept { return m_insert.top(); }
+
+  // prio_queue<>::top() is only const without a payload.
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, T const &>
+  insert_key() const noexcept
+  {
+    return const_cast<prio_queue<block_size, T, V, Compare>&>(m_insert).top().first;
+  }
+
+  std::pair<T const &, run_no &> heads_top() const noexcept
+  {
+    return const_cast<heads_queue&>(m_heads).top();
+  }
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, T const &>
+  head_key(run_no r) const noexcept { return m_runs[r].block[m_runs[r].pos]; }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, T const &>
+  head_key(run_no r) const noexcept { return m_runs[r].block[m_runs[r].pos].first; }
+
+  std::string                                m_directory;
+  std::uint64_t                              m_tag;
+  std::uint64_t                              m_files = 0;
+  std::size_t                                m_insert_capacity;
+  std::size_t                                m_block_elements;
+  std::size_t                                m_max_runs;
+  prio_queue<block_size, T, V, Compare>      m_insert;
+  // The first key of every run, and its run number.
+  heads_queue                                m_heads;
+  std::vector<run>                           m_runs;
+  std::vector<unsigned char>                 m_write_block;
+  std::vector<unsigned char>                 m_read_block;
+  std::size_t                                m_on_disk = 0;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+external_prio_queue<block_size, T, V, Compare>::
+external_prio_queue(std::string directory, std::size_t memory_budget,
+                    std::size_t io_block_size, Compare const &compare)
+  : Compare(compare)
+  , m_directory(std::move(directory))
+  , m_tag(std::random_device{}())
+  , m_insert(compare)
+  , m_heads(compare)
+{
+  // Room for a few runs, and a block each to read and write with.
+  io_block_size = std::min(io_block_size, memory_budget / 2 / 5);
+  m_block_elements = std::max<std::size_t>(io_block_size / record::size, 1);
+  auto const blocks = memory_budget / 2 / (m_block_elements * record::size);
+  m_max_runs = std::max<std::size_t>(blocks, 5) - 2;
+  m_insert_capacity = std::max<std::size_t>(memory_budget / 2 / record::size, 1);
+  // Reserved up front, since growing by doubling could take twice the share.
+  m_insert.reserve(m_insert_capacity);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+external_prio_queue<block_size, T, V, Compare>::
+push(U &&u)
+{
+  make_room();
+  m_insert.push(std::forward<U>(u));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+template <typename U, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+external_prio_queue<block_size, T, V, Compare>::
+push(U &&key, X &&value)
+{
+  make_room();
+  m_insert.push(std::forward<U>(key), std::forward<X>(value));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value, T const &>
+external_prio_queue<block_size, T, V, Compare>::
+top() const noexcept
+{
+  assert(!empty());
+  if (top_in_runs())
+  {
+    auto &r = m_runs[heads_top().second];
+    return r.block[r.pos];
+  }
+  return m_insert.top();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+external_prio_queue<block_size, T, V, Compare>::
+top() noexcept
+{
+  assert(!empty());
+  if (top_in_runs())
+  {
+    auto &r = m_runs[m_heads.top().second];
+    auto &e = r.block[r.pos];
+    return { e.first, e.second };
+  }
+  return m_insert.top();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+void
+external_prio_queue<block_size, T, V, Compare>::
+pop()
+{
+  assert(!empty());
+  if (!top_in_runs())
+  {
+    m_insert.pop();
+    return;
+  }
+  pop_run(m_heads);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+void
+external_prio_queue<block_size, T, V, Compare>::
+pop_run(heads_queue &heads)
+{
+  auto const r = heads.top().second;
+  --m_on_disk;
+  auto &rr = m_runs[r];
+  if (++rr.pos != rr.block.size())
+  {
+    heads.reschedule_top(head_key(r));
+    return;
+  }
+  heads.pop();
+  fill(r, heads);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+inline
+bool
+external_prio_queue<block_size, T, V, Compare>::
+empty()
+const
+noexcept
+{
+  return m_insert.empty() && m_heads.empty();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+inline
+std::size_t
+external_prio_queue<block_size, T, V, Compare>::
+size()
+const
+noexcept
+{
+  return m_insert.size() + m_on_disk;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+inline
+std::size_t
+external_prio_queue<block_size, T, V, Compare>::
+runs()
+const
+noexcept
+{
+  return m_heads.size();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+void
+external_prio_queue<block_size, T, V, Compare>::
+clear()
+noexcept
+{
+  m_insert.clear();
+  m_heads.clear();
+  m_runs.clear();
+  m_on_disk = 0;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+inline
+void
+external_prio_queue<block_size, T, V, Compare>::
+make_room()
+{
+  if (m_insert.size() == m_insert_capacity)
+  {
+    if (m_heads.size() == m_max_runs)
+    {
+      merge_runs();
+    }
+    write_run(m_insert);
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+inline
+bool
+external_prio_queue<block_size, T, V, Compare>::
+top_in_runs()
+const
+noexcept
+{
+  if (m_heads.empty()) return false;
+  if (m_insert.empty()) return true;
+  return Compare::operator()(heads_top().first, insert_key());
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+template <typename Q>
+void
+external_prio_queue<block_size, T, V, Compare>::
+write_run(Q &q)
+{
+  run_no r = 0;
+  while (r != m_runs.size() && m_runs[r].file) ++r;
+  if (r == m_runs.size())
+  {
+    assert(m_runs.size() < std::numeric_limits<run_no>::max());
+    m_runs.emplace_back();
+  }
+  m_runs[r].file = prio_q_internal::run_file(m_directory + "/prio_queue."
+                                      + std::to_string(m_tag) + "."
+                                      + std::to_string(m_files++));
+  m_write_block.resize(m_block_elements * record::size);
+  std::uint64_t count = 0;
+  try
+  {
+    while (!q.empty())
+    {
+      std::size_t n = 0;
+      for (; n != m_block_elements && !q.empty(); ++n)
+      {
+        record::encode(m_write_block.data() + n * record::size, q.pop_value());
+      }
+      m_runs[r].file.write(m_write_block.data(), n * record::size);
+      count += n;
+    }
+    m_runs[r].file.rewind();
+  }
+  catch (...)
+  {
+    // The partial file is removed, and the slot is free again.
+    m_runs[r] = run{};
+    throw;
+  }
+  m_runs[r].on_disk = count;
+  m_on_disk += count;
+  fill(r, m_heads);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+void
+external_prio_queue<block_size, T, V, Compare>::
+fill(run_no r, heads_queue &heads)
+{
+  auto &rr = m_runs[r];
+  rr.block.clear();
+  rr.pos = 0;
+  if (rr.on_disk == 0)
+  {
+    // Closes the file, and gives the memory of the block back.
+    rr = run{};
+    return;
+  }
+  auto const n = static_cast<std::size_t>(std::min<std::uint64_t>(rr.on_disk, m_block_elements));
+  m_read_block.resize(m_block_elements * record::size);
+  rr.file.read(m_read_block.data(), n * record::size);
+  rr.on_disk -= n;
+  rr.block.reserve(m_block_elements);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    rr.block.push_back(record::decode(m_read_block.data() + i * record::size));
+  }
+  heads.push(head_key(r), r);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+void
+external_prio_queue<block_size, T, V, Compare>::
+merge_runs()
+{
+  // Merging the smaller half keeps the runs in a few levels of similar
+  // sizes, instead of rewriting everything on disk every time.
+  std::vector<run_no> open;
+  for (run_no r = 0; r != m_runs.size(); ++r)
+  {
+    if (m_runs[r].file) open.push_back(r);
+  }
+  auto const n = std::max<std::size_t>(open.size() / 2, 2);
+  std::nth_element(open.begin(), open.begin() + (n - 1), open.end(),
+                   [this](run_no l, run_no r) { return remaining(l) < remaining(r); });
+  std::vector<bool> merging(m_runs.size());
+  heads_queue heads(static_cast<Compare const&>(*this));
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    merging[open[i]] = true;
+    heads.push(head_key(open[i]), open[i]);
+  }
+  m_heads.erase_if([&](auto const &e) { return merging[e.second]; });
+
+  // The runs merged, popped in order as if they were a queue of their own.
+  // They are all open when the new run is created, so it gets a slot of its
+  // own.
+  struct merged
+  {
+    external_prio_queue *q;
+    heads_queue         &heads;
+    bool empty() const noexcept { return heads.empty(); }
+    typename element::type pop_value()
+    {
+      auto &r = q->m_runs[heads.top().second];
+      auto e = std::move(r.block[r.pos]);
+      q->pop_run(heads);
+      return e;
+    }
+  };
+  merged some{ this, heads };
+  try
+  {
+    write_run(some);
+  }
+  catch (...)
+  {
+    // What is left of the runs is still readable.
+    m_heads.merge(std::move(heads));
+    throw;
+  }
+}
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_EXTERNAL_PRIO_QUEUE_HPP
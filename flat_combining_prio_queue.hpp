@@ -0,0 +1,398 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_FLAT_COMBINING_PRIO_QUEUE_HPP
+#define ROLLBEAR_FLAT_COMBINING_PRIO_QUEUE_HPP
+
+#include "prio_queue.hpp"
+#include "concurrency_support.hpp"
+#include <atomic>
+#include <vector>
+
+namespace rollbear
+{
+
+// A thread safe prio_queue<>, after the flat combining technique of Hendler,
+// Incze, Shavit and Tzafrir. A thread publishes its push() or try_pop()
+// request in a slot of its own, and whichever thread gets the combiner role
+// applies all published requests to the queue in one go, while the others
+// spin on their slots. The queue is only ever touched by one thread, so it
+// stays in cache, and the lock is taken once per batch instead of once per
+// operation.
+//
+// Within a batch, the pushes are ordered before the pops. A pop that is
+// matched by a pushed key at least as good as the top is handed that
+// element directly, and a pop that takes the top while there are pushes
+// left moves one of them into the hole with reschedule_top() instead of a
+// pop() followed by a push(). Unlike multi_queue<>, the order is strict.
+//
+// T and V must be default constructible, since each slot holds a key and a
+// payload. An exception thrown by T, V or the allocator while combining
+// terminates the program, since the waiting threads can not be told.
+template <std::size_t block_size, typename T, typename V,
+                                  typename Compare = std::less<T>,
+                                  typename Allocator = std::allocator<T>>
+class flat_combining_prio_queue : private Compare
+{
+  using queue = prio_queue<block_size, T, V, Compare, Allocator>;
+  using slot_value = std::conditional_t<std::is_same<V, void>::value, bool, V>;
+  enum : unsigned { slot_free, slot_claimed, push_pending, pop_pending, slot_done };
+  struct slot
+  {
+    std::atomic<unsigned> state{slot_free};
+    T                     key;
+    slot_value            value;
+    bool                  popped;
+  };
+public:
+  using value_type = T;
+  using payload_type = V;
+
+  explicit flat_combining_prio_queue(std::size_t num_threads,
+                                     Compare const &compare = Compare());
+
+  template <typename U, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  push(U &&u);
+
+  template <typename U, typename X>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  push(U &&key, X &&value);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, bool>
+  try_pop(T &key);
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, bool>
+  try_pop(T &key, U &value);
+
+  // Both are snapshots, that may be outdated already when returned, if
+  // other threads are operating on the queue.
+  bool empty() const noexcept;
+  std::size_t size() const noexcept;
+private:
+  slot &claim_slot() noexcept;
+  void execute(slot &s, unsigned request) noexcept;
+  void combine() noexcept;
+  void done(slot &s) noexcept;
+
+  void pop_from_queue(slot &s);
+  void exchange_top(slot &pop, slot &push);
+  void hand_over(slot &pop, slot &push);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value>
+  push_to_queue(slot &s) { m_queue.push(std::move(s.key)); }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value>
+  push_to_queue(slot &s) { m_queue.push(std::move(s.key), std::move(s.value)); }
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value>
+  take_top_payload(slot &) noexcept { }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value>
+  take_top_payload(slot &s) { s.value = std::move(m_queue.top().second); }
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value>
+  put_top_payload(slot &) noexcept { }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value>
+  put_top_payload(slot &s) { m_queue.top().second = std::move(s.value); }
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, T const &>
+  top_key() noexcept { return m_queue.top(); }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, T const &>
+  top_key() noexcept { return m_queue.top().first; }
+
+  bool sorts_before(value_type const &lv, value_type const &rv) const noexcept;
+
+  prio_q_internal::cache_aligned_array<slot> m_slots;
+  std::atomic<bool>                          m_combining{false};
+  std::atomic<std::size_t>                   m_size{0};
+  // Only touched by the combiner.
+  queue                                      m_queue;
+  std::vector<slot*>                         m_pushes;
+  std::vector<slot*>                         m_pops;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+flat_combining_prio_queue(std::size_t num_threads, Compare const &compare)
+  : Compare(compare)
+  , m_slots(std::max<std::size_t>(num_threads, 1U))
+  , m_queue(compare)
+{
+  m_pushes.reserve(m_slots.size());
+  m_pops.reserve(m_slots.size());
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+push(U &&u)
+{
+  auto &s = claim_slot();
+  s.key = std::forward<U>(u);
+  execute(s, push_pending);
+  s.state.store(slot_free, std::memory_order_release);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+push(U &&key, X &&value)
+{
+  auto &s = claim_slot();
+  s.key = std::forward<U>(key);
+  s.value = std::forward<X>(value);
+  execute(s, push_pending);
+  s.state.store(slot_free, std::memory_order_release);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value, bool>
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+try_pop(T &key)
+{
+  auto &s = claim_slot();
+  execute(s, pop_pending);
+  auto const popped = s.popped;
+  if (popped) key = std::move(s.key);
+  s.state.store(slot_free, std::memory_order_release);
+  return popped;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, bool>
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+try_pop(T &key, U &value)
+{
+  auto &s = claim_slot();
+  execute(s, pop_pending);
+  auto const popped = s.popped;
+  if (popped)
+  {
+    key = std::move(s.key);
+    value = std::move(s.value);
+  }
+  s.state.store(slot_free, std::memory_order_release);
+  return popped;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+bool
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+empty()
+const
+noexcept
+{
+  return size() == 0;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+std::size_t
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+size()
+const
+noexcept
+{
+  return m_size.load(std::memory_order_relaxed);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+auto
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+claim_slot()
+noexcept
+-> slot &
+{
+  // Each thread has a home slot. With more threads than slots, some share,
+  // and the loser looks for another free one.
+  auto const num_slots = m_slots.size();
+  for (auto i = prio_q_internal::thread_index() % num_slots;;
+       i = (i + 1) % num_slots)
+  {
+    auto &s = m_slots[i];
+    unsigned expected = slot_free;
+    if (s.state.load(std::memory_order_relaxed) == slot_free
+        && s.state.compare_exchange_strong(expected, slot_claimed,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed))
+    {
+      return s;
+    }
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+execute(slot &s, unsigned request)
+noexcept
+{
+  s.state.store(request, std::memory_order_release);
+  for (unsigned spins = 0;
+       s.state.load(std::memory_order_acquire) != slot_done;
+       ++spins)
+  {
+    if (!m_combining.load(std::memory_order_relaxed)
+        && !m_combining.exchange(true, std::memory_order_acquire))
+    {
+      combine();
+      m_combining.store(false, std::memory_order_release);
+    }
+    else if (spins > 64)
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+combine()
+noexcept
+{
+  m_pushes.clear();
+  m_pops.clear();
+  for (std::size_t i = 0; i != m_slots.size(); ++i)
+  {
+    auto &s = m_slots[i];
+    auto const state = s.state.load(std::memory_order_acquire);
+    if (state == push_pending) m_pushes.push_back(&s);
+    else if (state == pop_pending) m_pops.push_back(&s);
+  }
+  for (auto pop : m_pops)
+  {
+    auto best = m_pushes.begin();
+    for (auto i = best; i != m_pushes.end(); ++i)
+    {
+      if (sorts_before((*i)->key, (*best)->key)) best = i;
+    }
+    if (best != m_pushes.end()
+        && (m_queue.empty() || !sorts_before(top_key(), (*best)->key)))
+    {
+      hand_over(*pop, **best);
+      done(**best);
+      *best = m_pushes.back();
+      m_pushes.pop_back();
+    }
+    else if (m_queue.empty())
+    {
+      pop->popped = false;
+    }
+    else if (!m_pushes.empty())
+    {
+      exchange_top(*pop, *m_pushes.back());
+      done(*m_pushes.back());
+      m_pushes.pop_back();
+    }
+    else
+    {
+      pop_from_queue(*pop);
+    }
+    done(*pop);
+  }
+  for (auto push : m_pushes)
+  {
+    push_to_queue(*push);
+    done(*push);
+  }
+  m_size.store(m_queue.size(), std::memory_order_relaxed);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+done(slot &s)
+noexcept
+{
+  s.state.store(slot_done, std::memory_order_release);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+pop_from_queue(slot &s)
+{
+  s.key = top_key();
+  take_top_payload(s);
+  m_queue.pop();
+  s.popped = true;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+exchange_top(slot &pop, slot &push)
+{
+  pop.key = top_key();
+  take_top_payload(pop);
+  put_top_payload(push);
+  m_queue.reschedule_top(std::move(push.key));
+  pop.popped = true;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+void
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+hand_over(slot &pop, slot &push)
+{
+  pop.key = std::move(push.key);
+  pop.value = std::move(push.value);
+  pop.popped = true;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+bool
+flat_combining_prio_queue<block_size, T, V, Compare, Allocator>::
+sorts_before(value_type const &lv, value_type const &rv)
+const
+noexcept
+{
+  Compare const &c = *this;
+  return c(lv, rv);
+}
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_FLAT_COMBINING_PRIO_QUEUE_HPP
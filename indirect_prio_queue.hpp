@@ -0,0 +1,461 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_INDIRECT_PRIO_QUEUE_HPP
+#define ROLLBEAR_INDIRECT_PRIO_QUEUE_HPP
+
+#include "prio_queue.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace rollbear
+{
+namespace prio_q_internal
+{
+
+constexpr std::size_t max_of(std::size_t a, std::size_t b)
+{
+  return a > b ? a : b;
+}
+
+// A key and the slab slot of its payload. When they fit in 8 bytes, the
+// entry is aligned as one, so that moving it is a single 64 bit load and
+// store.
+template <typename T>
+struct alignas(max_of(max_of(alignof(T), alignof(std::uint32_t)),
+                      sizeof(T) + sizeof(std::uint32_t) <= 8 ? 8 : 1))
+indirect_entry
+{
+  T             key;
+  std::uint32_t slot;
+};
+
+template <typename T, typename Compare>
+struct indirect_compare : private Compare
+{
+  indirect_compare(Compare const &c = Compare()) : Compare(c) { }
+  bool operator()(indirect_entry<T> const &l, indirect_entry<T> const &r) const
+  {
+    return Compare::operator()(l.key, r.key);
+  }
+};
+
+// Payloads in chunks of chunk_size slots, that are never moved, addressed by
+// 32 bit slot numbers. Slots that are erased are reused before the slab
+// grows.
+template <typename V, typename Allocator, std::size_t chunk_size = 256>
+class slab : private std::allocator_traits<Allocator>::template rebind_alloc<V>
+{
+  using VA = typename std::allocator_traits<Allocator>::template rebind_alloc<V>;
+  using A = std::allocator_traits<VA>;
+  using chunk_alloc = typename A::template rebind_alloc<V*>;
+  using slot_alloc = typename A::template rebind_alloc<std::uint32_t>;
+  static constexpr std::size_t chunk_mask = chunk_size - 1;
+  static constexpr std::size_t chunk_shift = ilog2(chunk_size);
+  static_assert((chunk_size & chunk_mask) == 0U, "chunk size must be 2^n");
+public:
+  explicit slab(Allocator const &alloc = Allocator()) noexcept;
+  slab(slab &&s) noexcept;
+  ~slab() noexcept(std::is_nothrow_destructible<V>::value);
+
+  template <typename ... Args>
+  std::uint32_t emplace(Args&& ... args);
+
+  V &operator[](std::uint32_t slot) noexcept;
+
+  void erase(std::uint32_t slot) noexcept(std::is_nothrow_destructible<V>::value);
+
+  void reserve(std::size_t n);
+
+  void clear() noexcept(std::is_nothrow_destructible<V>::value);
+private:
+  V *address(std::size_t slot) const noexcept;
+
+  std::vector<V*, chunk_alloc>            m_chunks;
+  std::vector<std::uint32_t, slot_alloc>  m_free;
+  std::size_t                             m_end = 0;
+};
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+inline
+slab<V, Allocator, chunk_size>::
+slab(Allocator const &alloc) noexcept
+  : VA(alloc)
+  , m_chunks(chunk_alloc(alloc))
+  , m_free(slot_alloc(alloc))
+{
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+inline
+slab<V, Allocator, chunk_size>::
+slab(slab &&s) noexcept
+  : VA(static_cast<VA&>(s))
+  , m_chunks(std::move(s.m_chunks))
+  , m_free(std::move(s.m_free))
+  , m_end(s.m_end)
+{
+  s.m_chunks.clear();
+  s.m_free.clear();
+  s.m_end = 0;
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+slab<V, Allocator, chunk_size>::
+~slab() noexcept(std::is_nothrow_destructible<V>::value)
+{
+  clear();
+  for (auto chunk : m_chunks)
+  {
+    A::deallocate(*this, chunk, chunk_size);
+  }
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+template <typename ... Args>
+std::uint32_t
+slab<V, Allocator, chunk_size>::
+emplace(Args&& ... args)
+{
+  if (!m_free.empty())
+  {
+    auto const slot = m_free.back();
+    A::construct(*this, address(slot), std::forward<Args>(args)...);
+    m_free.pop_back();
+    return slot;
+  }
+  if (m_end == std::numeric_limits<std::uint32_t>::max())
+  {
+    throw std::length_error("indirect_prio_queue is full");
+  }
+  if (m_end == m_chunks.size() * chunk_size || m_end == m_free.capacity())
+  {
+    reserve(m_end + 1);
+  }
+  A::construct(*this, address(m_end), std::forward<Args>(args)...);
+  return static_cast<std::uint32_t>(m_end++);
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+inline
+V &
+slab<V, Allocator, chunk_size>::
+operator[](std::uint32_t slot) noexcept
+{
+  assert(slot < m_end);
+  return *address(slot);
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+inline
+void
+slab<V, Allocator, chunk_size>::
+erase(std::uint32_t slot) noexcept(std::is_nothrow_destructible<V>::value)
+{
+  assert(slot < m_end);
+  A::destroy(*this, address(slot));
+  m_free.push_back(slot);
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+void
+slab<V, Allocator, chunk_size>::
+reserve(std::size_t n)
+{
+  while (m_chunks.size() * chunk_size < n)
+  {
+    auto chunk = A::allocate(*this, chunk_size);
+    try
+    {
+      m_chunks.push_back(chunk);
+    }
+    catch (...)
+    {
+      A::deallocate(*this, chunk, chunk_size);
+      throw;
+    }
+  }
+  // Room for every slot to be freed, so that erase() never allocates.
+  auto const slots = m_chunks.size() * chunk_size;
+  if (m_free.capacity() < slots)
+  {
+    m_free.reserve(std::max(slots, 2 * m_free.capacity()));
+  }
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+void
+slab<V, Allocator, chunk_size>::
+clear() noexcept(std::is_nothrow_destructible<V>::value)
+{
+  if (!std::is_trivially_destructible<V>::value)
+  {
+    // The slots not on the free list are the ones in use.
+    std::sort(m_free.begin(), m_free.end());
+    auto free = m_free.begin();
+    for (std::size_t slot = 0; slot != m_end; ++slot)
+    {
+      if (free != m_free.end() && *free == slot)
+      {
+        ++free;
+        continue;
+      }
+      A::destroy(*this, address(slot));
+    }
+  }
+  m_free.clear();
+  m_end = 0;
+}
+
+template <typename V, typename Allocator, std::size_t chunk_size>
+inline
+V *
+slab<V, Allocator, chunk_size>::
+address(std::size_t slot) const noexcept
+{
+  return m_chunks[slot >> chunk_shift] + (slot & chunk_mask);
+}
+
+} // namespace prio_q_internal
+
+// The interface of prio_queue<> with a payload, for payloads that are
+// expensive to move. The payloads are kept in a slab where they never move,
+// and the heap only holds the keys and the 32 bit slot numbers of their
+// payloads, packed into one 8 byte word when the key is at most 4 bytes. A
+// sift step then moves one word, however large the payload is, but reaching
+// a payload costs an extra indirection, so for small payloads prio_queue<> is
+// faster. At most 2^32 - 1 elements can be held.
+template <std::size_t block_size, typename T, typename V,
+                                  typename Compare = std::less<T>,
+                                  typename Allocator = std::allocator<T>,
+                                  std::size_t arity = 2>
+class indirect_prio_queue
+{
+  static_assert(!std::is_same<V, void>::value,
+                "indirect_prio_queue<> is for queues with a payload");
+  using entry = prio_q_internal::indirect_entry<T>;
+  using entry_alloc = typename std::allocator_traits<Allocator>::template rebind_alloc<entry>;
+  using heap = prio_queue<block_size, entry, void,
+                          prio_q_internal::indirect_compare<T, Compare>,
+                          entry_alloc, arity>;
+public:
+  using value_type = T;
+  using payload_type = V;
+  using allocator_type = Allocator;
+
+  indirect_prio_queue(Compare const &compare = Compare());
+  explicit indirect_prio_queue(Compare const &compare, Allocator const &a);
+
+  template <typename U, typename X>
+  void push(U &&key, X &&value);
+
+  template <typename U, typename ... Args>
+  void emplace(U &&key, Args&& ... args);
+
+  std::pair<T const &, V &> top() noexcept;
+
+  void pop() noexcept(std::is_nothrow_destructible<V>::value);
+
+  std::pair<T, V> pop_value();
+
+  void reschedule_top(T t);
+
+  template <typename U, typename X>
+  void replace_top(U &&key, X &&value);
+
+  bool empty() const noexcept;
+
+  std::size_t size() const noexcept;
+
+  void reserve(std::size_t n);
+
+  void clear() noexcept(std::is_nothrow_destructible<V>::value);
+private:
+  heap                                      m_heap;
+  prio_q_internal::slab<V, Allocator>       m_slab;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+indirect_prio_queue(Compare const &compare)
+  : m_heap(prio_q_internal::indirect_compare<T, Compare>(compare))
+{
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+indirect_prio_queue(Compare const &compare, Allocator const &a)
+  : m_heap(prio_q_internal::indirect_compare<T, Compare>(compare), entry_alloc(a))
+  , m_slab(a)
+{
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+template <typename U, typename X>
+inline
+void
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+push(U &&key, X &&value)
+{
+  emplace(std::forward<U>(key), std::forward<X>(value));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+template <typename U, typename ... Args>
+inline
+void
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+emplace(U &&key, Args&& ... args)
+{
+  T k(std::forward<U>(key));
+  auto const slot = m_slab.emplace(std::forward<Args>(args)...);
+  try
+  {
+    m_heap.push(entry{ std::move(k), slot });
+  }
+  catch (...)
+  {
+    m_slab.erase(slot);
+    throw;
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+std::pair<T const &, V &>
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+top()
+noexcept
+{
+  assert(!empty());
+  auto &e = m_heap.top();
+  return { e.key, m_slab[e.slot] };
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+void
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+pop()
+noexcept(std::is_nothrow_destructible<V>::value)
+{
+  assert(!empty());
+  auto const slot = m_heap.top().slot;
+  m_heap.pop();
+  m_slab.erase(slot);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+std::pair<T, V>
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+pop_value()
+{
+  assert(!empty());
+  auto const slot = m_heap.top().slot;
+  std::pair<T, V> top(m_heap.pop_value().key, std::move(m_slab[slot]));
+  m_slab.erase(slot);
+  return top;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+void
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+reschedule_top(T t)
+{
+  assert(!empty());
+  m_heap.reschedule_top(entry{ std::move(t), m_heap.top().slot });
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+template <typename U, typename X>
+inline
+void
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+replace_top(U &&key, X &&value)
+{
+  assert(!empty());
+  // Both may refer to the top.
+  T k(std::forward<U>(key));
+  V val(std::forward<X>(value));
+  auto const slot = m_heap.top().slot;
+  m_slab[slot] = std::move(val);
+  m_heap.reschedule_top(entry{ std::move(k), slot });
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+bool
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+empty()
+const
+noexcept
+{
+  return m_heap.empty();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+std::size_t
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+size()
+const
+noexcept
+{
+  return m_heap.size();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+void
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+reserve(std::size_t n)
+{
+  m_heap.reserve(n);
+  m_slab.reserve(n);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity>
+inline
+void
+indirect_prio_queue<block_size, T, V, Compare, Allocator, arity>::
+clear()
+noexcept(std::is_nothrow_destructible<V>::value)
+{
+  m_heap.clear();
+  m_slab.clear();
+}
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_INDIRECT_PRIO_QUEUE_HPP
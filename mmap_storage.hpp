@@ -0,0 +1,401 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_MMAP_STORAGE_HPP
+#define ROLLBEAR_MMAP_STORAGE_HPP
+
+#include "prio_queue.hpp"
+#include <sys/mman.h>
+#include <cstring>
+#include <new>
+
+namespace rollbear
+{
+namespace prio_q_internal
+{
+
+// The interface of skip_vector, for trivially copyable types only, kept in
+// an anonymous memory mapping instead of memory from an allocator. On Linux
+// the mapping is grown with mremap(), which moves page table entries
+// instead of copying the elements, and is advised to use transparent huge
+// pages, which cuts the TLB misses when walking down a large heap. Elsewhere
+// growing maps a new area and copies, like skip_vector does.
+template <typename T, std::size_t block_size>
+class mmap_skip_vector
+{
+  static constexpr std::size_t block_mask = block_size - 1;
+  static_assert((block_size & block_mask) == 0U, "block size must be 2^n");
+  static_assert(std::is_trivially_copyable<T>::value
+                && std::is_trivially_destructible<T>::value,
+                "mmap_skip_vector can only hold trivially copyable types");
+public:
+  // Mappings are made in multiples of this, the size of a huge page on
+  // x86_64 and most aarch64 configurations.
+  static constexpr std::size_t mapping_granularity = std::size_t(2) << 20;
+
+           mmap_skip_vector() noexcept = default;
+  // The memory is never taken from an allocator, so it is ignored.
+  template <typename Allocator>
+  explicit mmap_skip_vector(Allocator const &) noexcept { }
+           mmap_skip_vector(mmap_skip_vector &&v) noexcept;
+           mmap_skip_vector(mmap_skip_vector const &v)
+             : mmap_skip_vector(v, v.m_end) { }
+  // A copy in a new mapping with room for at least storage_size slots.
+           mmap_skip_vector(mmap_skip_vector const &v, std::size_t storage_size);
+
+  ~mmap_skip_vector() noexcept;
+
+  mmap_skip_vector &operator=(mmap_skip_vector &&v) noexcept;
+  mmap_skip_vector &operator=(mmap_skip_vector const &v);
+
+  T       &operator[](std::size_t idx) noexcept;
+  T const &operator[](std::size_t idx) const noexcept;
+
+  void prefetch(std::size_t idx) const noexcept;
+
+  T           &back() noexcept;
+  T const     &back() const noexcept;
+
+  template <typename ... Args>
+  std::size_t emplace_back(Args&& ... args);
+
+  template <typename U>
+  std::size_t push_back(U &&u) { return emplace_back(std::forward<U>(u)); }
+
+  void        pop_back() noexcept;
+
+  void        clear() noexcept;
+
+  void        reserve(std::size_t storage_size);
+  void        shrink_to_fit();
+
+  bool        empty() const noexcept;
+  std::size_t size() const noexcept;
+  std::size_t capacity() const noexcept;
+private:
+  void remap(std::size_t storage_size);
+
+  static std::size_t bytes_for(std::size_t storage_size) noexcept;
+
+  T           *m_ptr          = nullptr;
+  std::size_t m_end           = 0;
+  std::size_t m_storage_size  = 0;
+  std::size_t m_mapped_bytes  = 0;
+};
+
+template <typename T, std::size_t block_size>
+inline
+mmap_skip_vector<T, block_size>::
+mmap_skip_vector(mmap_skip_vector &&v) noexcept
+  : m_ptr(v.m_ptr)
+  , m_end(v.m_end)
+  , m_storage_size(v.m_storage_size)
+  , m_mapped_bytes(v.m_mapped_bytes)
+{
+  v.m_ptr = nullptr;
+  v.m_end = 0;
+  v.m_storage_size = 0;
+  v.m_mapped_bytes = 0;
+}
+
+template <typename T, std::size_t block_size>
+inline
+mmap_skip_vector<T, block_size>::
+mmap_skip_vector(mmap_skip_vector const &v, std::size_t storage_size)
+{
+  reserve(std::max(storage_size, v.m_end));
+  if (v.m_end)
+  {
+    std::memcpy(m_ptr, v.m_ptr, v.m_end * sizeof(T));
+  }
+  m_end = v.m_end;
+}
+
+template <typename T, std::size_t block_size>
+inline
+mmap_skip_vector<T, block_size>::
+~mmap_skip_vector() noexcept
+{
+  if (m_ptr)
+  {
+    ::munmap(m_ptr, m_mapped_bytes);
+  }
+}
+
+template <typename T, std::size_t block_size>
+inline
+mmap_skip_vector<T, block_size> &
+mmap_skip_vector<T, block_size>::
+operator=(mmap_skip_vector &&v) noexcept
+{
+  if (this != &v)
+  {
+    if (m_ptr)
+    {
+      ::munmap(m_ptr, m_mapped_bytes);
+    }
+    m_ptr          = v.m_ptr;
+    m_end          = v.m_end;
+    m_storage_size = v.m_storage_size;
+    m_mapped_bytes = v.m_mapped_bytes;
+    v.m_ptr = nullptr;
+    v.m_end = 0;
+    v.m_storage_size = 0;
+    v.m_mapped_bytes = 0;
+  }
+  return *this;
+}
+
+template <typename T, std::size_t block_size>
+inline
+mmap_skip_vector<T, block_size> &
+mmap_skip_vector<T, block_size>::
+operator=(mmap_skip_vector const &v)
+{
+  if (this != &v)
+  {
+    m_end = 0;
+    reserve(v.m_end);
+    if (v.m_end)
+    {
+      std::memcpy(m_ptr, v.m_ptr, v.m_end * sizeof(T));
+    }
+    m_end = v.m_end;
+  }
+  return *this;
+}
+
+template <typename T, std::size_t block_size>
+inline
+T &
+mmap_skip_vector<T, block_size>::
+operator[](std::size_t idx) noexcept
+{
+  assert(idx < m_end);
+  assert((idx & block_mask) != 0);
+  return m_ptr[idx];
+}
+
+template <typename T, std::size_t block_size>
+inline
+T const &
+mmap_skip_vector<T, block_size>::
+operator[](std::size_t idx) const noexcept
+{
+  assert(idx < m_end);
+  assert((idx & block_mask) != 0);
+  return m_ptr[idx];
+}
+
+template <typename T, std::size_t block_size>
+inline
+void
+mmap_skip_vector<T, block_size>::
+prefetch(std::size_t idx) const noexcept
+{
+#if defined(__GNUC__) && defined(ROLLBEAR_PRIO_QUEUE_PREFETCH_DISTANCE)
+  __builtin_prefetch(m_ptr + idx);
+#else
+  static_cast<void>(idx);
+#endif
+}
+
+template <typename T, std::size_t block_size>
+inline
+T &
+mmap_skip_vector<T, block_size>::
+back() noexcept
+{
+  assert(!empty());
+  return m_ptr[m_end - 1];
+}
+
+template <typename T, std::size_t block_size>
+inline
+T const &
+mmap_skip_vector<T, block_size>::
+back() const noexcept
+{
+  assert(!empty());
+  return m_ptr[m_end - 1];
+}
+
+template <typename T, std::size_t block_size>
+template <typename ... Args>
+inline
+std::size_t
+mmap_skip_vector<T, block_size>::
+emplace_back(Args&& ... args)
+{
+  if (m_end & block_mask)
+  {
+    new (m_ptr + m_end) T(std::forward<Args>(args)...);
+    return m_end++;
+  }
+  if (m_end == m_storage_size)
+  {
+    // The arguments may refer to elements, that the remap moves.
+    T t(std::forward<Args>(args)...);
+    remap(m_storage_size ? m_storage_size * 2 : 1);
+    new (m_ptr + m_end + 1) T(t);
+  }
+  else
+  {
+    new (m_ptr + m_end + 1) T(std::forward<Args>(args)...);
+  }
+  m_end += 2;
+  return m_end - 1;
+}
+
+template <typename T, std::size_t block_size>
+inline
+void
+mmap_skip_vector<T, block_size>::
+pop_back() noexcept
+{
+  assert(m_end);
+  --m_end;
+  m_end -= (m_end & block_mask) == 1;
+}
+
+template <typename T, std::size_t block_size>
+inline
+void
+mmap_skip_vector<T, block_size>::
+clear() noexcept
+{
+  m_end = 0;
+}
+
+template <typename T, std::size_t block_size>
+inline
+void
+mmap_skip_vector<T, block_size>::
+reserve(std::size_t storage_size)
+{
+  if (storage_size > m_storage_size)
+  {
+    remap(storage_size);
+  }
+}
+
+template <typename T, std::size_t block_size>
+inline
+void
+mmap_skip_vector<T, block_size>::
+shrink_to_fit()
+{
+  if (bytes_for(m_end) < m_mapped_bytes)
+  {
+    remap(m_end);
+  }
+}
+
+template <typename T, std::size_t block_size>
+inline
+std::size_t
+mmap_skip_vector<T, block_size>::
+bytes_for(std::size_t storage_size) noexcept
+{
+  auto const bytes = storage_size * sizeof(T);
+  return (bytes + mapping_granularity - 1) & ~(mapping_granularity - 1);
+}
+
+template <typename T, std::size_t block_size>
+void
+mmap_skip_vector<T, block_size>::
+remap(std::size_t storage_size)
+{
+  auto const bytes = bytes_for(storage_size);
+  void *ptr = nullptr;
+  if (bytes == 0)
+  {
+    ::munmap(m_ptr, m_mapped_bytes);
+  }
+  else if (!m_ptr)
+  {
+    ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) throw std::bad_alloc();
+  }
+  else
+  {
+#ifdef MREMAP_MAYMOVE
+    ptr = ::mremap(m_ptr, m_mapped_bytes, bytes, MREMAP_MAYMOVE);
+    if (ptr == MAP_FAILED) throw std::bad_alloc();
+#else
+    ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) throw std::bad_alloc();
+    std::memcpy(ptr, m_ptr, std::min(bytes, m_mapped_bytes));
+    ::munmap(m_ptr, m_mapped_bytes);
+#endif
+  }
+#ifdef MADV_HUGEPAGE
+  // Only a hint. It fails harmlessly where transparent huge pages are
+  // disabled. The kernel aligns large anonymous mappings to the huge page
+  // size by itself, so no effort is made to do that here.
+  if (ptr) ::madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+  m_ptr          = static_cast<T*>(ptr);
+  m_mapped_bytes = bytes;
+  m_storage_size = (bytes / sizeof(T)) & ~block_mask;
+}
+
+template <typename T, std::size_t block_size>
+inline
+bool
+mmap_skip_vector<T, block_size>::
+empty() const noexcept
+{
+  return size() == 0;
+}
+
+template <typename T, std::size_t block_size>
+inline
+std::size_t
+mmap_skip_vector<T, block_size>::
+size() const noexcept
+{
+  return m_end;
+}
+
+template <typename T, std::size_t block_size>
+inline
+std::size_t
+mmap_skip_vector<T, block_size>::
+capacity() const noexcept
+{
+  return m_storage_size;
+}
+
+} // namespace prio_q_internal
+
+// Storage policy for prio_queue<>, that keeps trivially copyable keys and
+// payloads in anonymous memory mappings, grown with mremap() and backed by
+// transparent huge pages where available. Keys and payloads of other types
+// are kept in a skip_vector from the allocator, as with contiguous_storage.
+// Mappings are made in steps of 2MiB, so this is for large queues only.
+struct mmap_storage
+{
+  template <typename T, std::size_t block_size, typename Allocator>
+  using vector = std::conditional_t<
+    std::is_trivially_copyable<T>::value
+    && std::is_trivially_destructible<T>::value,
+    prio_q_internal::mmap_skip_vector<T, block_size>,
+    prio_q_internal::skip_vector<T, block_size, Allocator>>;
+};
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_MMAP_STORAGE_HPP
@@ -0,0 +1,287 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_MULTI_QUEUE_HPP
+#define ROLLBEAR_MULTI_QUEUE_HPP
+
+#include "prio_queue.hpp"
+#include "concurrency_support.hpp"
+#include <mutex>
+#include <atomic>
+
+namespace rollbear
+{
+
+// A relaxed concurrent priority queue, after the MultiQueue of Rihani,
+// Sanders and Dementiev. The elements are spread over
+// relaxation * num_threads prio_queue<> shards, each protected by its own
+// lock. push() goes to a random shard, and try_pop() takes the better of the
+// tops of two randomly chosen shards. The popped element is thus not
+// necessarily the best in the queue, but close to it, with the expected rank
+// growing with the number of shards.
+template <std::size_t block_size, typename T, typename V,
+                                  typename Compare = std::less<T>,
+                                  typename Allocator = std::allocator<T>>
+class multi_queue : private Compare
+{
+  using queue = prio_queue<block_size, T, V, Compare, Allocator>;
+  struct shard
+  {
+    explicit shard(Compare const &compare) : q(compare) { }
+    std::mutex               mutex;
+    queue                    q;
+    std::atomic<std::size_t> size{0};
+  };
+public:
+  using value_type = T;
+  using payload_type = V;
+
+  explicit multi_queue(std::size_t num_threads,
+                       std::size_t relaxation = 2,
+                       Compare const &compare = Compare());
+
+  template <typename U, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  push(U &&u);
+
+  template <typename U, typename X>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  push(U &&key, X &&value);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, bool>
+  try_pop(T &key);
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, bool>
+  try_pop(T &key, U &value);
+
+  // Both are snapshots, that may be outdated already when returned, if
+  // other threads are operating on the queue.
+  bool empty() const noexcept;
+  std::size_t size() const noexcept;
+
+  std::size_t num_shards() const noexcept;
+private:
+  template <typename F>
+  void with_random_shard(F&& f);
+
+  template <typename F>
+  bool pop_best(F&& f);
+
+  std::size_t random_shard() noexcept;
+
+  template <typename U = V>
+  static
+  std::enable_if_t<std::is_same<U, void>::value, T const &>
+  top_key(queue &q) noexcept { return q.top(); }
+
+  template <typename U = V>
+  static
+  std::enable_if_t<!std::is_same<U, void>::value, T const &>
+  top_key(queue &q) noexcept { return q.top().first; }
+
+  bool sorts_before(value_type const &lv, value_type const &rv) const noexcept;
+
+  prio_q_internal::cache_aligned_array<shard> m_shards;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+multi_queue<block_size, T, V, Compare, Allocator>::
+multi_queue(std::size_t num_threads, std::size_t relaxation, Compare const &compare)
+  : Compare(compare)
+  , m_shards(std::max<std::size_t>(num_threads * relaxation, 2U), compare)
+{
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+multi_queue<block_size, T, V, Compare, Allocator>::
+push(U &&u)
+{
+  with_random_shard([&](queue &q) { q.push(std::forward<U>(u)); });
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+multi_queue<block_size, T, V, Compare, Allocator>::
+push(U &&key, X &&value)
+{
+  with_random_shard([&](queue &q) {
+    q.push(std::forward<U>(key), std::forward<X>(value));
+  });
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value, bool>
+multi_queue<block_size, T, V, Compare, Allocator>::
+try_pop(T &key)
+{
+  return pop_best([&](queue &q) {
+    key = q.top();
+    q.pop();
+  });
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, bool>
+multi_queue<block_size, T, V, Compare, Allocator>::
+try_pop(T &key, U &value)
+{
+  return pop_best([&](queue &q) {
+    auto top = q.top();
+    key = top.first;
+    value = std::move(top.second);
+    q.pop();
+  });
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+bool
+multi_queue<block_size, T, V, Compare, Allocator>::
+empty()
+const
+noexcept
+{
+  return size() == 0;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+std::size_t
+multi_queue<block_size, T, V, Compare, Allocator>::
+size()
+const
+noexcept
+{
+  std::size_t sum = 0;
+  for (std::size_t i = 0; i != m_shards.size(); ++i)
+  {
+    sum += m_shards[i].size.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+std::size_t
+multi_queue<block_size, T, V, Compare, Allocator>::
+num_shards()
+const
+noexcept
+{
+  return m_shards.size();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename F>
+inline
+void
+multi_queue<block_size, T, V, Compare, Allocator>::
+with_random_shard(F&& f)
+{
+  for (;;)
+  {
+    auto &s = m_shards[random_shard()];
+    std::unique_lock<std::mutex> lock(s.mutex, std::try_to_lock);
+    if (!lock) continue;
+    f(s.q);
+    s.size.store(s.q.size(), std::memory_order_relaxed);
+    return;
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <typename F>
+inline
+bool
+multi_queue<block_size, T, V, Compare, Allocator>::
+pop_best(F&& f)
+{
+  auto const num_shards = m_shards.size();
+  // Sample a number of times. Empty shards are common when the queue is
+  // nearly empty, but finding only empty shards says nothing about the
+  // others.
+  for (std::size_t attempt = 0; attempt != num_shards; ++attempt)
+  {
+    auto i = random_shard();
+    auto j = random_shard();
+    if (i == j) j = (j + 1) % num_shards;
+    auto *s1 = &m_shards[i];
+    auto *s2 = &m_shards[j];
+    if (s1->size.load(std::memory_order_relaxed) == 0) std::swap(s1, s2);
+    if (s1->size.load(std::memory_order_relaxed) == 0) continue;
+    std::unique_lock<std::mutex> l1(s1->mutex, std::try_to_lock);
+    if (!l1) continue;
+    std::unique_lock<std::mutex> l2(s2->mutex, std::try_to_lock);
+    auto *best = s1->q.empty() ? nullptr : s1;
+    if (l2 && !s2->q.empty()
+        && (!best || sorts_before(top_key(s2->q), top_key(s1->q))))
+    {
+      best = s2;
+    }
+    if (!best) continue;
+    f(best->q);
+    best->size.store(best->q.size(), std::memory_order_relaxed);
+    return true;
+  }
+  // Linear scan, to tell whether the queue really is empty.
+  for (std::size_t i = 0; i != num_shards; ++i)
+  {
+    auto &s = m_shards[i];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (!s.q.empty())
+    {
+      f(s.q);
+      s.size.store(s.q.size(), std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+std::size_t
+multi_queue<block_size, T, V, Compare, Allocator>::
+random_shard()
+noexcept
+{
+  return prio_q_internal::thread_rng()() % m_shards.size();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+inline
+bool
+multi_queue<block_size, T, V, Compare, Allocator>::
+sorts_before(value_type const &lv, value_type const &rv)
+const
+noexcept
+{
+  Compare const &c = *this;
+  return c(lv, rv);
+}
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_MULTI_QUEUE_HPP
@@ -12,6 +12,14 @@
  */
 
 #include "prio_queue.hpp"
+#include "addressable_prio_queue.hpp"
+#include "multi_queue.hpp"
+#include "flat_combining_prio_queue.hpp"
+#include "mmap_storage.hpp"
+#include "radix_prio_queue.hpp"
+#include "timer_queue.hpp"
+#include "indirect_prio_queue.hpp"
+#include "external_prio_queue.hpp"
 #include <tachymeter/benchmark.hpp>
 #include <tachymeter/seq.hpp>
 #include <tachymeter/CSV_reporter.hpp>
@@ -22,22 +30,33 @@
 #include <iostream>
 
 #include <memory>
+#include <cstring>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
 using namespace std::literals::chrono_literals;
 using namespace tachymeter;
 using Clock = std::chrono::high_resolution_clock;
 using rollbear::prio_queue;
+using rollbear::addressable_prio_queue;
 
 struct null_obj_t
 {
   constexpr operator int() const { return 0; }
   template <typename T>
   constexpr operator std::unique_ptr<T>() const { return nullptr; }
+  operator std::string() const { return {}; }
 };
 
 static const constexpr null_obj_t null_obj{ };
 static int n[600000];
 auto const test_sizes        = powers(seq(1, 2, 5), 1, 100000, 10);
+auto const bulk_test_sizes   = powers(seq(1, 2, 5), 1000, 500000, 10);
+// far beyond the last level cache
+auto const large_test_sizes  = powers(seq(1, 2, 5), 1000000, 20000000, 10);
+auto const huge_test_sizes   = powers(seq(1, 2, 5), 10000000, 100000000, 10);
 auto const min_test_duration = 1000ms;
 
 template <typename T>
@@ -102,6 +121,98 @@ private:
   Q q;
 };
 
+template <typename E>
+inline
+std::enable_if_t<is_pair<E>::value, E>
+make_element(int n)
+{
+  return E(n, null_obj);
+}
+
+template <typename E>
+inline
+std::enable_if_t<!is_pair<E>::value, E>
+make_element(int n)
+{
+  return E(n);
+}
+
+template <typename Q>
+class bulk_load
+{
+  using element = std::conditional_t<std::is_void<typename Q::payload_type>::value,
+                                     typename Q::value_type,
+                                     std::pair<typename Q::value_type,
+                                               typename Q::payload_type>>;
+public:
+  bulk_load(uint64_t size)
+  {
+    v.reserve(size);
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      v.push_back(make_element<element>(n[i]));
+    }
+  }
+  void operator()(uint64_t)
+  {
+    Q q(std::make_move_iterator(v.begin()), std::make_move_iterator(v.end()));
+  }
+private:
+  std::vector<element> v;
+};
+
+template <typename Q, uint64_t batch_size>
+class push_batch
+{
+  using element = std::conditional_t<std::is_void<typename Q::payload_type>::value,
+                                     typename Q::value_type,
+                                     std::pair<typename Q::value_type,
+                                               typename Q::payload_type>>;
+public:
+  push_batch(uint64_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+    v.reserve(batch_size);
+    for (uint64_t i = 0; i != batch_size; ++i)
+    {
+      v.push_back(make_element<element>(n[size + i]));
+    }
+  }
+  void operator()(uint64_t)
+  {
+    q.push_range(std::make_move_iterator(v.begin()),
+                 std::make_move_iterator(v.end()));
+  }
+private:
+  Q q;
+  std::vector<element> v;
+};
+
+template <typename Q, uint64_t batch_size>
+class push_loop
+{
+public:
+  push_loop(uint64_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+  }
+  void operator()(uint64_t size)
+  {
+    for (uint64_t i = 0; i != batch_size; ++i)
+    {
+      add(q, n[size + i]);
+    }
+  }
+private:
+  Q q;
+};
+
 template <typename Q>
 class pop_all
 {
@@ -124,6 +235,202 @@ private:
   Q q;
 };
 
+// Take the best num_popped with top() and pop(), and push them back with new
+// keys, like a dispatcher taking a batch at a time.
+template <typename Q, uint64_t num_popped>
+class pop_batch
+{
+public:
+  pop_batch(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+    batch.reserve(num_popped);
+  }
+  void operator()(uint64_t)
+  {
+    batch.clear();
+    for (uint64_t i = 0; i != num_popped; ++i)
+    {
+      batch.push_back(q.top().first);
+      q.pop();
+    }
+    push_back();
+  }
+protected:
+  void push_back()
+  {
+    for (auto k : batch)
+    {
+      add(q, k + static_cast<int>(gen() >> 8));
+    }
+  }
+  std::minstd_rand gen;
+  std::vector<int> batch;
+  Q q;
+};
+
+// The same, with pop_n().
+template <typename Q, uint64_t num_popped>
+class pop_n_batch : pop_batch<Q, num_popped>
+{
+public:
+  using pop_batch<Q, num_popped>::pop_batch;
+  void operator()(uint64_t)
+  {
+    popped.clear();
+    this->q.pop_n(num_popped, std::back_inserter(popped));
+    this->batch.clear();
+    for (auto &e : popped) this->batch.push_back(e.first);
+    this->push_back();
+  }
+private:
+  std::vector<std::pair<int, typename Q::payload_type>> popped;
+};
+
+template <typename Q>
+class drain_all
+{
+public:
+  drain_all(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+    out.reserve(size);
+  }
+  void operator()(uint64_t)
+  {
+    q.drain(std::back_inserter(out));
+  }
+private:
+  std::vector<std::pair<int, typename Q::payload_type>> out;
+  Q q;
+};
+
+// The hold model: pop the top and push it back with a random increment,
+// which is what a simulation's event queue does.
+template <typename Q, uint64_t num_ops>
+class hold
+{
+public:
+  hold(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, static_cast<int>(gen() >> 1));
+    }
+  }
+  void operator()(uint64_t)
+  {
+    for (uint64_t i = 0; i != num_ops; ++i)
+    {
+      auto const k = top_key(q);
+      q.pop();
+      add(q, k + static_cast<int>(gen() >> 12));
+    }
+  }
+private:
+  template <typename U = Q>
+  static std::enable_if_t<std::is_void<typename U::payload_type>::value, int>
+  top_key(U &q) { return q.top(); }
+
+  template <typename U = Q>
+  static std::enable_if_t<!std::is_void<typename U::payload_type>::value, int>
+  top_key(U &q) { return q.top().first; }
+
+  std::minstd_rand gen;
+  Q q;
+};
+
+// Like hold, but with the deadlines of timers, where most expire within a
+// few hundred ticks, and a few far into the future.
+template <typename Q, uint64_t num_ops>
+class timers
+{
+public:
+  timers(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, delay());
+    }
+  }
+  void operator()(uint64_t)
+  {
+    for (uint64_t i = 0; i != num_ops; ++i)
+    {
+      auto const now = top_key(q);
+      q.pop();
+      add(q, now + delay());
+    }
+  }
+private:
+  int delay()
+  {
+    auto const r = gen();
+    return r % 20 ? static_cast<int>(r % 500)
+                  : static_cast<int>(r % 10000000);
+  }
+
+  template <typename U = Q>
+  static std::enable_if_t<std::is_void<typename U::payload_type>::value, int>
+  top_key(U &q) { return q.top(); }
+
+  template <typename U = Q>
+  static std::enable_if_t<!std::is_void<typename U::payload_type>::value, int>
+  top_key(U &q) { return q.top().first; }
+
+  std::minstd_rand gen;
+  Q q;
+};
+
+// Fill an empty queue with random keys, which includes the cost of growing
+// the storage, for sizes beyond the static key array.
+template <typename Q>
+class grow
+{
+public:
+  grow(uint64_t) { }
+  void operator()(uint64_t size)
+  {
+    Q q;
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, static_cast<int>(gen() >> 1));
+    }
+  }
+private:
+  std::minstd_rand gen;
+};
+
+// pop() num_ops times from a queue of random keys.
+template <typename Q, uint64_t num_ops>
+class pop_some
+{
+public:
+  pop_some(std::size_t size)
+  {
+    std::minstd_rand gen;
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, static_cast<int>(gen() >> 1));
+    }
+  }
+  void operator()(uint64_t)
+  {
+    for (uint64_t i = 0; i != num_ops; ++i)
+    {
+      q.pop();
+    }
+  }
+private:
+  Q q;
+};
+
 template <typename Q, uint64_t delta_size, uint64_t num_cycles>
 class operate
 {
@@ -178,34 +485,636 @@ public:
       q.reschedule_top(*p++);
     }
   }
-private:
-  Q q;
-};
+private:
+  Q q;
+};
+
+template <typename Q, uint64_t num_cycles>
+class pop_push
+{
+public:
+  pop_push(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+  }
+  void operator()(uint64_t size)
+  {
+    auto p                = n + size;
+    auto remaining_cycles = num_cycles;
+    while (remaining_cycles--)
+    {
+      q.pop();
+      add(q, *p++);
+    }
+  }
+private:
+  Q q;
+};
+
+// As populate, but the payload is built from null_obj in its slot.
+template <typename Q>
+class populate_emplace
+{
+public:
+  populate_emplace(uint64_t) { }
+  void operator()(uint64_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      q.emplace(n[i], null_obj);
+    }
+  }
+private:
+  Q q;
+};
+
+// As pop_push, but the payload of the top is kept and given the new key.
+template <typename Q, uint64_t num_cycles>
+class replace_top
+{
+public:
+  replace_top(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+  }
+  void operator()(uint64_t size)
+  {
+    auto p                = n + size;
+    auto remaining_cycles = num_cycles;
+    while (remaining_cycles--)
+    {
+      q.replace_top(*p++, std::move(q.top().second));
+    }
+  }
+private:
+  Q q;
+};
+
+// Take every payload out, either by moving it out of top() before pop(), or
+// with pop_value().
+template <typename Q, bool use_pop_value>
+class take_all
+{
+public:
+  take_all(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+  }
+  void operator()(uint64_t size)
+  {
+    while (size--)
+    {
+      take(std::integral_constant<bool, use_pop_value>{});
+    }
+  }
+private:
+  void take(std::true_type)
+  {
+    auto v = q.pop_value();
+    static_cast<void>(v);
+  }
+  void take(std::false_type)
+  {
+    auto v = std::move(q.top().second);
+    q.pop();
+    static_cast<void>(v);
+  }
+  Q q;
+};
+
+// Move all elements of a queue of size / divisor to a queue of size, with
+// merge() or by popping and pushing them one at a time.
+template <typename Q, uint64_t divisor, bool use_merge>
+class merge_queues
+{
+public:
+  merge_queues(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+    // n is too short for two queues of the largest sizes, so other reuses
+    // the keys of q.
+    for (uint64_t i = 0; i != size / divisor; ++i)
+    {
+      add(other, n[i * divisor]);
+    }
+  }
+  void operator()(uint64_t)
+  {
+    merge(std::integral_constant<bool, use_merge>{});
+  }
+private:
+  void merge(std::true_type)
+  {
+    q.merge(std::move(other));
+  }
+  void merge(std::false_type)
+  {
+    while (!other.empty())
+    {
+      q.push(other.top().first, std::move(other.top().second));
+      other.pop();
+    }
+  }
+  Q q;
+  Q other;
+};
+
+// Move the elements below the middle of the key range, or the best half, to
+// another queue, with split() and split_half(), or by popping and pushing
+// them one at a time.
+template <typename Q, bool half, bool use_split>
+class split_queue
+{
+public:
+  split_queue(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+  }
+  void operator()(uint64_t)
+  {
+    split(std::integral_constant<bool, half>{},
+          std::integral_constant<bool, use_split>{});
+  }
+private:
+  void split(std::false_type, std::true_type)
+  {
+    other = q.split(5000000);
+  }
+  void split(std::true_type, std::true_type)
+  {
+    other = q.split_half();
+  }
+  void split(std::false_type, std::false_type)
+  {
+    while (!q.empty() && q.top().first < 5000000) move_top();
+  }
+  void split(std::true_type, std::false_type)
+  {
+    for (auto count = q.size() / 2; count; --count) move_top();
+  }
+  void move_top()
+  {
+    other.push(q.top().first, std::move(q.top().second));
+    q.pop();
+  }
+  Q q;
+  Q other;
+};
+
+// Fork a queue of size elements, with a copy, or by draining it and
+// building two queues from the elements.
+template <typename Q, bool use_copy>
+class fork_queue
+{
+public:
+  fork_queue(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+  }
+  void operator()(uint64_t)
+  {
+    fork(std::integral_constant<bool, use_copy>{});
+  }
+private:
+  void fork(std::true_type)
+  {
+    Q copy(q);
+    static_cast<void>(copy);
+  }
+  void fork(std::false_type)
+  {
+    std::vector<std::pair<typename Q::value_type, typename Q::payload_type>> v;
+    q.drain(std::back_inserter(v));
+    Q copy(v.begin(), v.end());
+    q.assign(std::make_move_iterator(v.begin()), std::make_move_iterator(v.end()));
+  }
+  Q q;
+};
+
+// Look at the best k elements of a queue of size elements, with
+// peek_top_k(), or by popping them from a copy.
+template <typename Q, std::size_t k, bool use_peek>
+class peek_top
+{
+public:
+  peek_top(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+    }
+    top.reserve(k);
+  }
+  void operator()(uint64_t)
+  {
+    top.clear();
+    peek(std::integral_constant<bool, use_peek>{});
+  }
+private:
+  void peek(std::true_type)
+  {
+    q.peek_top_k(k, std::back_inserter(top));
+  }
+  void peek(std::false_type)
+  {
+    auto copy = q;
+    copy.pop_n(k, std::back_inserter(top));
+  }
+  Q q;
+  std::vector<std::pair<typename Q::value_type, typename Q::payload_type>> top;
+};
+
+// Cancel one eighth of the elements of a queue of size elements, and halve
+// the keys of the rest, with erase_if() and transform_keys(), or by popping
+// them all into a new queue.
+template <typename Q, bool use_bulk>
+class cancel_scale
+{
+public:
+  cancel_scale(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      q.push(n[i], int(i));
+    }
+  }
+  void operator()(uint64_t)
+  {
+    edit(std::integral_constant<bool, use_bulk>{});
+  }
+private:
+  void edit(std::true_type)
+  {
+    q.erase_if([](auto const &e) { return e.second % 8 == 0; });
+    q.transform_keys([](int k) { return k / 2; });
+  }
+  void edit(std::false_type)
+  {
+    Q next;
+    while (!q.empty())
+    {
+      auto e = q.top();
+      if (e.second % 8 != 0) next.push(e.first / 2, e.second);
+      q.pop();
+    }
+    q = std::move(next);
+  }
+  Q q;
+};
+
+// Restart with a queue of size elements, from a snapshot, or by pushing
+// them all again.
+template <typename Q, bool use_snapshot>
+class restore_queue
+{
+public:
+  restore_queue(std::size_t size)
+  {
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, n[i]);
+      elements.emplace_back(n[i], n[i]);
+    }
+    q.save(snapshot);
+  }
+  void operator()(uint64_t)
+  {
+    restore(std::integral_constant<bool, use_snapshot>{});
+  }
+private:
+  void restore(std::true_type)
+  {
+    std::istringstream is(snapshot.str());
+    Q restored;
+    restored.load(is);
+  }
+  void restore(std::false_type)
+  {
+    Q restored;
+    for (auto &e : elements) restored.push(e.first, e.second);
+  }
+  Q q;
+  std::ostringstream snapshot;
+  std::vector<std::pair<typename Q::value_type, typename Q::payload_type>> elements;
+};
+
+// How the queues of fill_drain<> are made. External queues get a small
+// memory budget, so that the sizes measured are up to 10 times as large.
+template <typename Q>
+struct make_queue
+{
+  static Q make() { return Q{}; }
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare>
+struct make_queue<rollbear::external_prio_queue<block_size, T, V, Compare>>
+{
+  static rollbear::external_prio_queue<block_size, T, V, Compare> make()
+  {
+    return rollbear::external_prio_queue<block_size, T, V, Compare>("/tmp", 16 << 20);
+  }
+};
+
+// Push size random keys to an empty queue, and pop them all.
+template <typename Q>
+class fill_drain
+{
+public:
+  fill_drain(uint64_t) { }
+  void operator()(uint64_t size)
+  {
+    auto q = make_queue<Q>::make();
+    for (uint64_t i = 0; i != size; ++i)
+    {
+      add(q, static_cast<int>(gen() >> 1));
+    }
+    while (!q.empty())
+    {
+      q.pop();
+    }
+  }
+private:
+  std::minstd_rand gen;
+};
+
+struct graph
+{
+  struct edge
+  {
+    uint32_t to;
+    uint32_t weight;
+  };
+  graph(std::size_t nodes)
+    : first(nodes + 1)
+  {
+    std::mt19937                            gen(nodes);
+    std::uniform_int_distribution<uint32_t> node(0, uint32_t(nodes - 1));
+    std::uniform_int_distribution<uint32_t> weight(1, 1000);
+    for (std::size_t i = 0; i != nodes; ++i)
+    {
+      first[i] = edges.size();
+      for (int e = 0; e != 8; ++e)
+      {
+        edges.push_back({ node(gen), weight(gen) });
+      }
+    }
+    first[nodes] = edges.size();
+  }
+  std::vector<std::size_t> first;
+  std::vector<edge>        edges;
+};
+
+static const constexpr uint32_t    infinite = ~uint32_t{};
+static const constexpr std::size_t unseen   = ~std::size_t{};
+static const constexpr std::size_t done     = unseen - 1;
+
+class dijkstra_lazy
+{
+public:
+  dijkstra_lazy(uint64_t size) : g(size), dist(size) { }
+  void operator()(uint64_t)
+  {
+    std::fill(dist.begin(), dist.end(), infinite);
+    prio_queue<16, uint32_t, uint32_t> q;
+    dist[0] = 0;
+    q.push(0U, 0U);
+    while (!q.empty())
+    {
+      auto const d = q.top().first;
+      auto const u = q.top().second;
+      q.pop();
+      if (d != dist[u]) continue;
+      for (auto e = g.first[u]; e != g.first[u + 1]; ++e)
+      {
+        auto const& edge = g.edges[e];
+        auto const  nd   = d + edge.weight;
+        if (nd < dist[edge.to])
+        {
+          dist[edge.to] = nd;
+          q.push(nd, edge.to);
+        }
+      }
+    }
+  }
+private:
+  graph                 g;
+  std::vector<uint32_t> dist;
+};
+
+class dijkstra_addressable
+{
+  using queue = addressable_prio_queue<16, uint32_t, uint32_t>;
+public:
+  dijkstra_addressable(uint64_t size) : g(size), dist(size), handles(size) { }
+  void operator()(uint64_t)
+  {
+    std::fill(dist.begin(), dist.end(), infinite);
+    std::fill(handles.begin(), handles.end(), unseen);
+    queue q;
+    dist[0] = 0;
+    handles[0] = q.push(0U, 0U);
+    while (!q.empty())
+    {
+      auto const d = q.top().first;
+      auto const u = q.top().second;
+      q.pop();
+      handles[u] = done;
+      for (auto e = g.first[u]; e != g.first[u + 1]; ++e)
+      {
+        auto const& edge = g.edges[e];
+        auto const  nd   = d + edge.weight;
+        if (nd < dist[edge.to])
+        {
+          dist[edge.to] = nd;
+          auto& h = handles[edge.to];
+          if (h == unseen)
+          {
+            h = q.push(nd, edge.to);
+          }
+          else
+          {
+            q.update(h, nd);
+          }
+        }
+      }
+    }
+  }
+private:
+  graph                    g;
+  std::vector<uint32_t>    dist;
+  std::vector<std::size_t> handles;
+};
+
+void measure_dijkstra(int argc, char *argv[])
+{
+  CSV_reporter     reporter("/tmp/q/dijkstra", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<dijkstra_lazy>(bulk_test_sizes,
+                                   "dijkstra lazy insertion prio_queue",
+                                   min_test_duration);
+  benchmark.measure<dijkstra_addressable>(bulk_test_sizes,
+                                          "dijkstra addressable_prio_queue",
+                                          min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+class locked_prio_queue
+{
+public:
+  locked_prio_queue(std::size_t) { }
+  void push(int k, int v)
+  {
+    std::lock_guard<std::mutex> lock(m);
+    q.push(k, v);
+  }
+  bool try_pop(int &k, int &v)
+  {
+    std::lock_guard<std::mutex> lock(m);
+    if (q.empty()) return false;
+    k = q.top().first;
+    v = q.top().second;
+    q.pop();
+    return true;
+  }
+private:
+  std::mutex               m;
+  prio_queue<16, int, int> q;
+};
+
+using concurrent_multi_queue = rollbear::multi_queue<16, int, int>;
+using concurrent_flat_combining = rollbear::flat_combining_prio_queue<16, int, int>;
+
+static const constexpr int      concurrent_key_range = 1 << 20;
+static const constexpr uint64_t concurrent_prefill   = 100000;
+static const constexpr uint64_t concurrent_ops       = 200000;
+
+struct logged_op
+{
+  uint64_t seq;
+  int      key;
+  bool     push;
+};
+
+// Each thread alternates between pushing a random key and popping. With a
+// log, every completed operation is stamped from a shared counter, which
+// serializes the threads somewhat, so the log is only used for the rank
+// error and not for the throughput.
+template <typename Q>
+double run_concurrent(Q &q, unsigned num_threads,
+                      std::vector<std::vector<logged_op>> *log)
+{
+  std::atomic<uint64_t> seq{concurrent_prefill};
+  std::atomic<unsigned> ready{0};
+  std::vector<std::thread> threads;
+  auto const start = [&] {
+    ++ready;
+    while (ready != num_threads + 1) std::this_thread::yield();
+  };
+  for (unsigned t = 0; t != num_threads; ++t)
+  {
+    threads.emplace_back([&, t] {
+      std::minstd_rand                gen(t + 1);
+      std::uniform_int_distribution<> dist(0, concurrent_key_range - 1);
+      start();
+      int k;
+      int v;
+      for (uint64_t i = 0; i != concurrent_ops / num_threads; ++i)
+      {
+        k = dist(gen);
+        q.push(k, k);
+        if (log) (*log)[t].push_back({ seq++, k, true });
+        if (q.try_pop(k, v) && log) (*log)[t].push_back({ seq++, k, false });
+      }
+    });
+  }
+  start();
+  auto const begin = Clock::now();
+  for (auto &t : threads) t.join();
+  std::chrono::duration<double> elapsed = Clock::now() - begin;
+  return double(concurrent_ops) * 2 / elapsed.count() / 1e6;
+}
 
-template <typename Q, uint64_t num_cycles>
-class pop_push
+// Replays the log in stamp order, and for every pop counts how many
+// elements in the queue at the time were better than the popped one.
+inline
+double mean_rank_error(std::vector<std::vector<logged_op>> const &log,
+                       std::vector<int> const &prefill)
 {
-public:
-  pop_push(std::size_t size)
+  std::vector<logged_op> ops;
+  for (auto &l : log) ops.insert(ops.end(), l.begin(), l.end());
+  std::sort(ops.begin(), ops.end(),
+            [](auto const &l, auto const &r) { return l.seq < r.seq; });
+  std::vector<int> tree(concurrent_key_range + 1);
+  auto const add = [&](int key, int delta) {
+    for (int i = key + 1; i <= concurrent_key_range; i += i & -i) tree[i] += delta;
+  };
+  auto const count_below = [&](int key) {
+    int sum = 0;
+    for (int i = key; i > 0; i -= i & -i) sum += tree[i];
+    return sum;
+  };
+  for (auto key : prefill) add(key, 1);
+  double   sum  = 0;
+  uint64_t pops = 0;
+  for (auto &op : ops)
   {
-    for (uint64_t i = 0; i != size; ++i)
+    if (op.push)
     {
-      add(q, n[i]);
+      add(op.key, 1);
+      continue;
     }
+    // A pop may be stamped before the push it raced with, so the count
+    // can go negative.
+    sum += std::max(count_below(op.key), 0);
+    ++pops;
+    add(op.key, -1);
   }
-  void operator()(uint64_t size)
+  return pops ? sum / pops : 0.0;
+}
+
+template <typename Q>
+void measure_concurrent(char const *name, unsigned max_threads)
+{
+  std::vector<int> prefill(concurrent_prefill);
+  std::minstd_rand gen(4711);
+  std::uniform_int_distribution<> dist(0, concurrent_key_range - 1);
+  for (auto &k : prefill) k = dist(gen);
+
+  for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2)
   {
-    auto p                = n + size;
-    auto remaining_cycles = num_cycles;
-    while (remaining_cycles--)
-    {
-      q.pop();
-      add(q, *p++);
-    }
+    Q q(num_threads);
+    for (auto k : prefill) q.push(k, k);
+    auto const mops = run_concurrent(q, num_threads, nullptr);
+
+    Q logged_q(num_threads);
+    for (auto k : prefill) logged_q.push(k, k);
+    std::vector<std::vector<logged_op>> log(num_threads);
+    run_concurrent(logged_q, num_threads, &log);
+
+    std::cout << name << ", " << num_threads << " threads, "
+              << mops << " Mops/s, mean rank error "
+              << mean_rank_error(log, prefill) << '\n';
   }
-private:
-  Q q;
-};
+}
 
 inline
 bool operator<(const std::pair<int, std::unique_ptr<int>> &lh,
@@ -244,6 +1153,37 @@ void measure_prio_queue(int argc, char *argv[])
                                            "operate prio_queue<int,void>",
                                            min_test_duration);
 
+  benchmark.measure<populate<qint>>(bulk_test_sizes,
+                                    "bulk populate prio_queue<int,void>",
+                                    min_test_duration);
+  benchmark.measure<bulk_load<qint>>(bulk_test_sizes,
+                                     "bulk construct prio_queue<int,void>",
+                                     min_test_duration);
+  benchmark.measure<populate<qintint>>(bulk_test_sizes,
+                                       "bulk populate prio_queue<int,int>",
+                                       min_test_duration);
+  benchmark.measure<bulk_load<qintint>>(bulk_test_sizes,
+                                        "bulk construct prio_queue<int,int>",
+                                        min_test_duration);
+  benchmark.measure<push_loop<qintint, 1000>>(test_sizes,
+                                             "push 1000 prio_queue<int,int>",
+                                             min_test_duration);
+  benchmark.measure<push_batch<qintint, 1000>>(test_sizes,
+                                              "push_range 1000 prio_queue<int,int>",
+                                              min_test_duration);
+  benchmark.measure<push_loop<qintint, 50000>>(test_sizes,
+                                              "push 50000 prio_queue<int,int>",
+                                              min_test_duration);
+  benchmark.measure<push_batch<qintint, 50000>>(test_sizes,
+                                               "push_range 50000 prio_queue<int,int>",
+                                               min_test_duration);
+  benchmark.measure<populate<qintp>>(bulk_test_sizes,
+                                     "bulk populate prio_queue<int,ptr>",
+                                     min_test_duration);
+  benchmark.measure<bulk_load<qintp>>(bulk_test_sizes,
+                                      "bulk construct prio_queue<int,ptr>",
+                                      min_test_duration);
+
   benchmark.measure<populate<qintintp>>(test_sizes,
                                         "populate prio_queue<<int,int>, void>",
                                         min_test_duration);
@@ -294,6 +1234,537 @@ void measure_prio_queue(int argc, char *argv[])
   benchmark.run(argc, argv);
 }
 
+template <std::size_t size, std::size_t arity>
+void measure_arity(benchmark<Clock> &benchmark)
+{
+  using qint = prio_queue<size, int, void, std::less<int>, std::allocator<int>, arity>;
+  using qintint = prio_queue<size, int, int, std::less<int>, std::allocator<int>, arity>;
+
+  using std::to_string;
+  auto const params = "<" + to_string(size) + ", " + to_string(arity) + ">";
+
+  benchmark.measure<populate<qint>>(test_sizes,
+                                    "populate prio_queue<int,void>" + params,
+                                    min_test_duration);
+  benchmark.measure<pop_all<qint>>(test_sizes,
+                                   "pop all prio_queue<int,void>" + params,
+                                   min_test_duration);
+  benchmark.measure<operate<qint, 320, 200>>(test_sizes,
+                                           "operate prio_queue<int,void>" + params,
+                                           min_test_duration);
+  benchmark.measure<pop_all<qintint>>(test_sizes,
+                                      "pop all prio_queue<int,int>" + params,
+                                      min_test_duration);
+  benchmark.measure<reschedule<qintint, 1000>>(test_sizes,
+                                               "reschedule prio_queue<int,int>" + params,
+                                               min_test_duration);
+}
+
+// block size x arity within the blocks
+void measure_arities(int argc, char *argv[])
+{
+  CSV_reporter     reporter("/tmp/q/arity", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  measure_arity<16, 2>(benchmark);
+  measure_arity<16, 4>(benchmark);
+  measure_arity<32, 2>(benchmark);
+  measure_arity<32, 4>(benchmark);
+  measure_arity<32, 8>(benchmark);
+  measure_arity<64, 2>(benchmark);
+  measure_arity<64, 4>(benchmark);
+  measure_arity<64, 8>(benchmark);
+  measure_arity<64, 16>(benchmark);
+  benchmark.run(argc, argv);
+}
+
+// Same order as std::less<T>, but hides it from prio_queue<>, so that the
+// children are always compared one by one.
+template <typename T>
+struct scalar_less
+{
+  bool operator()(T const &lh, T const &rh) const { return lh < rh; }
+};
+
+template <typename T, std::size_t size, std::size_t arity>
+void measure_simd_key(benchmark<Clock> &benchmark)
+{
+  using alloc = std::allocator<T>;
+  using qsimd = prio_queue<size, T, void, std::less<T>, alloc, arity>;
+  using qscalar = prio_queue<size, T, void, scalar_less<T>, alloc, arity>;
+
+  using std::to_string;
+  auto const params = "<" + to_string(size) + ", " + to_string(arity) + "> "
+                      + to_string(sizeof(T)) + " byte "
+                      + (std::is_floating_point<T>::value ? "float" : "int");
+
+  benchmark.measure<pop_all<qsimd>>(test_sizes,
+                                    "pop all std::less " + params,
+                                    min_test_duration);
+  benchmark.measure<pop_all<qscalar>>(test_sizes,
+                                      "pop all scalar_less " + params,
+                                      min_test_duration);
+  benchmark.measure<operate<qsimd, 320, 200>>(test_sizes,
+                                              "operate std::less " + params,
+                                              min_test_duration);
+  benchmark.measure<operate<qscalar, 320, 200>>(test_sizes,
+                                                "operate scalar_less " + params,
+                                                min_test_duration);
+}
+
+// Vectorized against one by one child selection. Only measures a difference
+// when built for an ISA that has the kernels, e.g. with -march=native.
+void measure_simd(int argc, char *argv[])
+{
+  CSV_reporter     reporter("/tmp/q/simd", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  measure_simd_key<std::int32_t, 64, 8>(benchmark);
+  measure_simd_key<std::int32_t, 64, 16>(benchmark);
+  measure_simd_key<std::int64_t, 64, 8>(benchmark);
+  measure_simd_key<float, 64, 8>(benchmark);
+  measure_simd_key<float, 64, 16>(benchmark);
+  measure_simd_key<double, 64, 8>(benchmark);
+  benchmark.run(argc, argv);
+}
+
+// Build with -DROLLBEAR_PRIO_QUEUE_PREFETCH_DISTANCE=n to compare with
+// prefetching of the child blocks.
+void measure_large(int argc, char *argv[])
+{
+  CSV_reporter     reporter("/tmp/q/large", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<hold<prio_queue<16, int, void>, 100000>>(
+      large_test_sizes, "hold prio_queue<16, int, void>", min_test_duration);
+  benchmark.measure<hold<prio_queue<32, int, void>, 100000>>(
+      large_test_sizes, "hold prio_queue<32, int, void>", min_test_duration);
+  benchmark.measure<hold<prio_queue<64, int, void>, 100000>>(
+      large_test_sizes, "hold prio_queue<64, int, void>", min_test_duration);
+  benchmark.measure<hold<prio_queue<16, int, int>, 100000>>(
+      large_test_sizes, "hold prio_queue<16, int, int>", min_test_duration);
+  benchmark.measure<hold<prio_queue<32, int, int>, 100000>>(
+      large_test_sizes, "hold prio_queue<32, int, int>", min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+// A payload of size bytes, to see how the payload size matters.
+template <std::size_t size>
+struct sized_payload
+{
+  sized_payload(int i = 0) { std::memcpy(bytes, &i, sizeof(i)); }
+  char bytes[size];
+};
+
+template <typename V>
+void measure_layout(benchmark<Clock> &benchmark, std::string const &payload)
+{
+  using separate = prio_queue<16, int, V>;
+  using block = prio_queue<16, int, V, std::less<int>, std::allocator<int>, 2,
+                           rollbear::block_interleaved_storage>;
+  using line = prio_queue<16, int, V, std::less<int>, std::allocator<int>, 2,
+                          rollbear::line_interleaved_storage<>>;
+
+  auto const params = "<16, int, " + payload + ">";
+  benchmark.measure<pop_all<separate>>(bulk_test_sizes,
+                                       "pop all contiguous_storage" + params,
+                                       min_test_duration);
+  benchmark.measure<pop_all<block>>(bulk_test_sizes,
+                                    "pop all block_interleaved_storage" + params,
+                                    min_test_duration);
+  benchmark.measure<pop_all<line>>(bulk_test_sizes,
+                                   "pop all line_interleaved_storage" + params,
+                                   min_test_duration);
+  benchmark.measure<hold<separate, 100000>>(large_test_sizes,
+                                            "hold contiguous_storage" + params,
+                                            min_test_duration);
+  benchmark.measure<hold<block, 100000>>(large_test_sizes,
+                                         "hold block_interleaved_storage" + params,
+                                         min_test_duration);
+  benchmark.measure<hold<line, 100000>>(large_test_sizes,
+                                        "hold line_interleaved_storage" + params,
+                                        min_test_duration);
+}
+
+// Keys and payloads in separate arrays, or interleaved per block or per cache
+// line, with growing payloads, to find where interleaving stops paying off.
+void measure_layouts(int argc, char *argv[])
+{
+  CSV_reporter     reporter("/tmp/q/layout", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  measure_layout<int>(benchmark, "int");
+  measure_layout<std::int64_t>(benchmark, "int64_t");
+  measure_layout<sized_payload<16>>(benchmark, "16 bytes");
+  measure_layout<sized_payload<32>>(benchmark, "32 bytes");
+  benchmark.run(argc, argv);
+}
+
+template <typename V>
+void measure_indirection(benchmark<Clock> &benchmark, std::string const &payload)
+{
+  using direct = prio_queue<16, int, V>;
+  using indirect = rollbear::indirect_prio_queue<16, int, V>;
+
+  auto const params = "<16, int, " + payload + ">";
+  benchmark.measure<pop_all<direct>>(bulk_test_sizes,
+                                     "pop all prio_queue" + params,
+                                     min_test_duration);
+  benchmark.measure<pop_all<indirect>>(bulk_test_sizes,
+                                       "pop all indirect_prio_queue" + params,
+                                       min_test_duration);
+  benchmark.measure<hold<direct, 100000>>(large_test_sizes,
+                                          "hold prio_queue" + params,
+                                          min_test_duration);
+  benchmark.measure<hold<indirect, 100000>>(large_test_sizes,
+                                            "hold indirect_prio_queue" + params,
+                                            min_test_duration);
+}
+
+// Payloads moved along with the keys, or left in place in a slab, with
+// growing payloads, to find where the indirection starts paying off.
+void measure_indirect(int argc, char *argv[])
+{
+  CSV_reporter     reporter("/tmp/q/indirect", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  measure_indirection<sized_payload<16>>(benchmark, "16 bytes");
+  measure_indirection<sized_payload<64>>(benchmark, "64 bytes");
+  measure_indirection<sized_payload<128>>(benchmark, "128 bytes");
+  measure_indirection<sized_payload<256>>(benchmark, "256 bytes");
+  benchmark.run(argc, argv);
+}
+
+// The latency of every single push() while filling a queue, to see the
+// stalls when contiguous storage doubles.
+template <typename Q>
+void measure_push_latency(char const *name, std::size_t size)
+{
+  std::vector<std::chrono::nanoseconds> latencies;
+  latencies.reserve(size);
+  std::minstd_rand gen(4711);
+  Q q;
+  for (std::size_t i = 0; i != size; ++i)
+  {
+    auto const key = static_cast<int>(gen() >> 1);
+    auto const begin = Clock::now();
+    add(q, key);
+    latencies.push_back(Clock::now() - begin);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto const percentile = [&](double p) {
+    return latencies[static_cast<std::size_t>(p * double(size - 1))].count();
+  };
+  std::cout << name << ", " << size << " pushes, p50 " << percentile(0.5)
+            << "ns, p99.9 " << percentile(0.999)
+            << "ns, p99.99 " << percentile(0.9999)
+            << "ns, max " << latencies.back().count() << "ns\n";
+}
+
+void measure_storage(int argc, char *argv[])
+{
+  using contiguous = prio_queue<16, int, int>;
+  using segmented = prio_queue<16, int, int, std::less<int>, std::allocator<int>,
+                               2, rollbear::segmented_storage<4096>>;
+
+  for (std::size_t size : { 1000000, 10000000 })
+  {
+    measure_push_latency<contiguous>("contiguous_storage", size);
+    measure_push_latency<segmented>("segmented_storage<4096>", size);
+  }
+
+  CSV_reporter     reporter("/tmp/q/storage", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<populate<contiguous>>(bulk_test_sizes,
+                                          "populate contiguous_storage",
+                                          min_test_duration);
+  benchmark.measure<populate<segmented>>(bulk_test_sizes,
+                                         "populate segmented_storage<4096>",
+                                         min_test_duration);
+  benchmark.measure<pop_all<contiguous>>(test_sizes,
+                                         "pop all contiguous_storage",
+                                         min_test_duration);
+  benchmark.measure<pop_all<segmented>>(test_sizes,
+                                        "pop all segmented_storage<4096>",
+                                        min_test_duration);
+  benchmark.measure<hold<contiguous, 100000>>(large_test_sizes,
+                                              "hold contiguous_storage",
+                                              min_test_duration);
+  benchmark.measure<hold<segmented, 100000>>(large_test_sizes,
+                                             "hold segmented_storage<4096>",
+                                             min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_mmap(int argc, char *argv[])
+{
+  using contiguous = prio_queue<16, int, int>;
+  using mapped = prio_queue<16, int, int, std::less<int>, std::allocator<int>,
+                            2, rollbear::mmap_storage>;
+
+  CSV_reporter     reporter("/tmp/q/mmap", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<grow<contiguous>>(huge_test_sizes,
+                                      "grow contiguous_storage",
+                                      min_test_duration);
+  benchmark.measure<grow<mapped>>(huge_test_sizes,
+                                  "grow mmap_storage",
+                                  min_test_duration);
+  benchmark.measure<pop_some<contiguous, 1000000>>(huge_test_sizes,
+                                                   "pop contiguous_storage",
+                                                   min_test_duration);
+  benchmark.measure<pop_some<mapped, 1000000>>(huge_test_sizes,
+                                               "pop mmap_storage",
+                                               min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_pop_n(int argc, char *argv[])
+{
+  using qintint = prio_queue<16, int, int>;
+
+  CSV_reporter     reporter("/tmp/q/pop_n", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<pop_batch<qintint, 64>>(bulk_test_sizes,
+                                            "pop 64 prio_queue<int,int>",
+                                            min_test_duration);
+  benchmark.measure<pop_n_batch<qintint, 64>>(bulk_test_sizes,
+                                              "pop_n 64 prio_queue<int,int>",
+                                              min_test_duration);
+  benchmark.measure<pop_batch<qintint, 512>>(bulk_test_sizes,
+                                             "pop 512 prio_queue<int,int>",
+                                             min_test_duration);
+  benchmark.measure<pop_n_batch<qintint, 512>>(bulk_test_sizes,
+                                               "pop_n 512 prio_queue<int,int>",
+                                               min_test_duration);
+  benchmark.measure<pop_all<qintint>>(bulk_test_sizes,
+                                      "pop all prio_queue<int,int>",
+                                      min_test_duration);
+  benchmark.measure<drain_all<qintint>>(bulk_test_sizes,
+                                        "drain prio_queue<int,int>",
+                                        min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_emplace(int argc, char *argv[])
+{
+  using qintp = prio_queue<16, int, std::unique_ptr<int>>;
+
+  CSV_reporter     reporter("/tmp/q/emplace", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<populate<qintp>>(test_sizes,
+                                     "push prio_queue<int,unique_ptr<int>>",
+                                     min_test_duration);
+  benchmark.measure<populate_emplace<qintp>>(test_sizes,
+                                             "emplace prio_queue<int,unique_ptr<int>>",
+                                             min_test_duration);
+  benchmark.measure<pop_push<qintp, 320>>(test_sizes,
+                                          "pop push prio_queue<int,unique_ptr<int>>",
+                                          min_test_duration);
+  benchmark.measure<replace_top<qintp, 320>>(test_sizes,
+                                             "replace_top prio_queue<int,unique_ptr<int>>",
+                                             min_test_duration);
+  benchmark.measure<take_all<qintp, false>>(test_sizes,
+                                            "top pop prio_queue<int,unique_ptr<int>>",
+                                            min_test_duration);
+  benchmark.measure<take_all<qintp, true>>(test_sizes,
+                                           "pop_value prio_queue<int,unique_ptr<int>>",
+                                           min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_merge(int argc, char *argv[])
+{
+  using qintint = prio_queue<16, int, int>;
+
+  CSV_reporter     reporter("/tmp/q/merge", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<merge_queues<qintint, 1, true>>(bulk_test_sizes,
+                                                    "merge equal size",
+                                                    min_test_duration);
+  benchmark.measure<merge_queues<qintint, 1, false>>(bulk_test_sizes,
+                                                     "pop push equal size",
+                                                     min_test_duration);
+  benchmark.measure<merge_queues<qintint, 64, true>>(bulk_test_sizes,
+                                                     "merge 1/64 size",
+                                                     min_test_duration);
+  benchmark.measure<merge_queues<qintint, 64, false>>(bulk_test_sizes,
+                                                      "pop push 1/64 size",
+                                                      min_test_duration);
+  benchmark.measure<split_queue<qintint, false, true>>(bulk_test_sizes,
+                                                       "split",
+                                                       min_test_duration);
+  benchmark.measure<split_queue<qintint, false, false>>(bulk_test_sizes,
+                                                        "pop push below threshold",
+                                                        min_test_duration);
+  benchmark.measure<split_queue<qintint, true, true>>(bulk_test_sizes,
+                                                      "split_half",
+                                                      min_test_duration);
+  benchmark.measure<split_queue<qintint, true, false>>(bulk_test_sizes,
+                                                       "pop push half",
+                                                       min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_copy(int argc, char *argv[])
+{
+  using qintint = prio_queue<16, int, int>;
+  using qintstr = prio_queue<16, int, std::string>;
+
+  CSV_reporter     reporter("/tmp/q/copy", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<fork_queue<qintint, true>>(bulk_test_sizes,
+                                               "copy prio_queue<int,int>",
+                                               min_test_duration);
+  benchmark.measure<fork_queue<qintint, false>>(bulk_test_sizes,
+                                                "rebuild prio_queue<int,int>",
+                                                min_test_duration);
+  benchmark.measure<fork_queue<qintstr, true>>(bulk_test_sizes,
+                                               "copy prio_queue<int,string>",
+                                               min_test_duration);
+  benchmark.measure<fork_queue<qintstr, false>>(bulk_test_sizes,
+                                                "rebuild prio_queue<int,string>",
+                                                min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_peek(int argc, char *argv[])
+{
+  using qintint = prio_queue<16, int, int>;
+
+  CSV_reporter     reporter("/tmp/q/peek", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<peek_top<qintint, 32, true>>(test_sizes,
+                                                 "peek_top_k 32",
+                                                 min_test_duration);
+  benchmark.measure<peek_top<qintint, 32, false>>(test_sizes,
+                                                  "copy pop_n 32",
+                                                  min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_bulk_edit(int argc, char *argv[])
+{
+  using qintint = prio_queue<16, int, int>;
+
+  CSV_reporter     reporter("/tmp/q/bulk_edit", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<cancel_scale<qintint, true>>(bulk_test_sizes,
+                                                 "erase_if transform_keys",
+                                                 min_test_duration);
+  benchmark.measure<cancel_scale<qintint, false>>(bulk_test_sizes,
+                                                  "pop push",
+                                                  min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_snapshot(int argc, char *argv[])
+{
+  using qintint = prio_queue<16, int, int>;
+
+  CSV_reporter     reporter("/tmp/q/snapshot", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<restore_queue<qintint, true>>(bulk_test_sizes,
+                                                  "load prio_queue<int,int>",
+                                                  min_test_duration);
+  benchmark.measure<restore_queue<qintint, false>>(bulk_test_sizes,
+                                                   "push prio_queue<int,int>",
+                                                   min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_external(int argc, char *argv[])
+{
+  using memory = prio_queue<16, int, int>;
+  using external = rollbear::external_prio_queue<16, int, int>;
+
+  CSV_reporter     reporter("/tmp/q/external", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<fill_drain<memory>>(large_test_sizes,
+                                        "prio_queue<int,int>",
+                                        min_test_duration);
+  benchmark.measure<fill_drain<external>>(large_test_sizes,
+                                          "external_prio_queue<int,int> 16MiB",
+                                          min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+// Only workloads where no key is pushed below the last popped one, which is
+// what radix_prio_queue<> requires.
+void measure_radix(int argc, char *argv[])
+{
+  using qint = prio_queue<16, int, void>;
+  using qintint = prio_queue<16, int, int>;
+  using rint = rollbear::radix_prio_queue<int, void>;
+  using rintint = rollbear::radix_prio_queue<int, int>;
+
+  CSV_reporter     reporter("/tmp/q/radix", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<populate<qint>>(test_sizes,
+                                    "populate prio_queue<int,void>",
+                                    min_test_duration);
+  benchmark.measure<populate<rint>>(test_sizes,
+                                    "populate radix_prio_queue<int,void>",
+                                    min_test_duration);
+  benchmark.measure<pop_all<qint>>(test_sizes,
+                                   "pop all prio_queue<int,void>",
+                                   min_test_duration);
+  benchmark.measure<pop_all<rint>>(test_sizes,
+                                   "pop all radix_prio_queue<int,void>",
+                                   min_test_duration);
+  benchmark.measure<pop_all<qintint>>(test_sizes,
+                                      "pop all prio_queue<int,int>",
+                                      min_test_duration);
+  benchmark.measure<pop_all<rintint>>(test_sizes,
+                                      "pop all radix_prio_queue<int,int>",
+                                      min_test_duration);
+  benchmark.measure<hold<qint, 100000>>(large_test_sizes,
+                                        "hold prio_queue<int,void>",
+                                        min_test_duration);
+  benchmark.measure<hold<rint, 100000>>(large_test_sizes,
+                                        "hold radix_prio_queue<int,void>",
+                                        min_test_duration);
+  benchmark.measure<hold<qintint, 100000>>(large_test_sizes,
+                                           "hold prio_queue<int,int>",
+                                           min_test_duration);
+  benchmark.measure<hold<rintint, 100000>>(large_test_sizes,
+                                           "hold radix_prio_queue<int,int>",
+                                           min_test_duration);
+  benchmark.run(argc, argv);
+}
+
+void measure_timers(int argc, char *argv[])
+{
+  using qintint = prio_queue<16, int, int>;
+  using rintint = rollbear::radix_prio_queue<int, int>;
+  using tintint = rollbear::timer_queue<int, int>;
+
+  CSV_reporter     reporter("/tmp/q/timers", &std::cout);
+  benchmark<Clock> benchmark(reporter);
+
+  benchmark.measure<timers<qintint, 100000>>(large_test_sizes,
+                                             "timers prio_queue<int,int>",
+                                             min_test_duration);
+  benchmark.measure<timers<rintint, 100000>>(large_test_sizes,
+                                             "timers radix_prio_queue<int,int>",
+                                             min_test_duration);
+  benchmark.measure<timers<tintint, 100000>>(large_test_sizes,
+                                             "timers timer_queue<int,int>",
+                                             min_test_duration);
+  benchmark.run(argc, argv);
+}
+
 int main(int argc, char *argv[])
 {
   std::random_device              rd;
@@ -309,6 +1780,31 @@ int main(int argc, char *argv[])
   measure_prio_queue<32>(argc, argv);
   measure_prio_queue<64>(argc, argv);
 
+  measure_arities(argc, argv);
+  measure_simd(argc, argv);
+  measure_large(argc, argv);
+  measure_storage(argc, argv);
+  measure_layouts(argc, argv);
+  measure_indirect(argc, argv);
+  measure_mmap(argc, argv);
+  measure_pop_n(argc, argv);
+  measure_emplace(argc, argv);
+  measure_merge(argc, argv);
+  measure_copy(argc, argv);
+  measure_peek(argc, argv);
+  measure_bulk_edit(argc, argv);
+  measure_snapshot(argc, argv);
+  measure_external(argc, argv);
+  measure_radix(argc, argv);
+  measure_timers(argc, argv);
+  measure_dijkstra(argc, argv);
+
+  auto const max_threads = std::max(std::thread::hardware_concurrency(), 1U);
+  measure_concurrent<locked_prio_queue>("mutex + prio_queue", max_threads);
+  measure_concurrent<concurrent_multi_queue>("multi_queue", max_threads);
+  measure_concurrent<concurrent_flat_combining>("flat_combining_prio_queue",
+                                                max_threads);
+
 
   using qint = std::priority_queue<int>;
   using qintintp = std::priority_queue<std::pair<int, int>>;
@@ -18,7 +18,57 @@
 #include <cassert>
 #include <tuple>
 #include <cstddef>
+#include <iterator>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+
+// With C++17 and <memory_resource>, rollbear::pmr::prio_queue<> is a
+// prio_queue<> using std::pmr::polymorphic_allocator<>.
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define ROLLBEAR_PRIO_QUEUE_PMR 1
+#endif
+#endif
+
+// Define ROLLBEAR_PRIO_QUEUE_NO_SIMD to always compare children one by one.
+#if defined(__GNUC__) && defined(__AVX2__) && !defined(ROLLBEAR_PRIO_QUEUE_NO_SIMD)
+#define rollbear_prio_q_simd 1
+#include <immintrin.h>
+#endif
 
+// Define ROLLBEAR_PRIO_QUEUE_PREFETCH_DISTANCE to n, to have the sift down in
+// pop() and reschedule_top() prefetch the child blocks it may enter, and
+// their payloads, n levels before it reaches the leaves of a block. Every
+// level fans out arity times, so arity^(n + 1) blocks are prefetched. The
+// descent is one long chain of dependent loads, so there is little time to
+// hide the latency in, and whether it pays off must be measured for the
+// machine at hand. perf_benchmark has queues far larger than the caches.
+#if defined(__GNUC__) && defined(ROLLBEAR_PRIO_QUEUE_PREFETCH_DISTANCE)
+#define rollbear_prio_q_prefetch(p) __builtin_prefetch(p)
+#endif
+
+// The cache line size that prio_queue_auto<> picks block sizes for, and
+// ROLLBEAR_PRIO_QUEUE_BLOCK_SIZES, a list of { key size, payload size, block
+// size } measured to be best, which it uses instead of its estimate when
+// defined. autotune.cpp measures the machine it runs on and writes a header
+// defining both, to include before this one.
+#ifndef ROLLBEAR_PRIO_QUEUE_CACHE_LINE_SIZE
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__GNUC__)
+#define ROLLBEAR_PRIO_QUEUE_CACHE_LINE_SIZE std::hardware_destructive_interference_size
+#else
+// GCC warns that its value may differ between compilation units, which is
+// harmless here but noisy, so the common value is assumed instead.
+#define ROLLBEAR_PRIO_QUEUE_CACHE_LINE_SIZE 64
+#endif
+#endif
 
 #ifdef __GNUC__
 #define rollbear_prio_q_likely(x)       __builtin_expect(!!(x), 1)
@@ -45,22 +95,46 @@ public:
   explicit skip_vector(Allocator const &alloc)
            noexcept(std::is_nothrow_copy_constructible<T>::value);
            skip_vector(skip_vector &&v) noexcept;
+           skip_vector(skip_vector const &v) : skip_vector(v, v.m_end) { }
+  // A copy with every element in the same slot as in v, and room for at
+  // least storage_size slots. Trivially copyable elements are copied with
+  // one memcpy() of the whole buffer, gaps included.
+           skip_vector(skip_vector const &v, std::size_t storage_size);
 
   ~skip_vector() noexcept(std::is_nothrow_destructible<T>::value);
 
+  // Takes over the memory of v when the allocator propagates or the two
+  // compare equal, and otherwise moves the elements one by one into memory
+  // from its own allocator.
+  skip_vector &operator=(skip_vector &&v);
+  skip_vector &operator=(skip_vector const &v);
+
+  Allocator get_allocator() const noexcept { return *this; }
+
   T       &operator[](std::size_t idx) noexcept;
   T const &operator[](std::size_t idx) const noexcept;
 
+  void prefetch(std::size_t idx) const noexcept;
+
   T           &back() noexcept;
   T const     &back() const noexcept;
 
+  template <typename ... Args>
+  std::size_t emplace_back(Args&& ... args);
+
   template <typename U>
-  std::size_t push_back(U &&u);
+  std::size_t push_back(U &&u) { return emplace_back(std::forward<U>(u)); }
 
   void        pop_back() noexcept(std::is_nothrow_destructible<T>::value);
 
+  void        clear() noexcept(std::is_nothrow_destructible<T>::value);
+
+  void        reserve(std::size_t storage_size);
+  void        shrink_to_fit();
+
   bool        empty() const noexcept;
   std::size_t size() const noexcept;
+  std::size_t capacity() const noexcept;
 private:
   template <typename U = T>
   std::enable_if_t<std::is_standard_layout<U>::value && std::is_trivial<U>::value>
@@ -70,8 +144,36 @@ private:
   std::enable_if_t<!std::is_standard_layout<U>::value || !std::is_trivial<U>::value>
   destroy() noexcept(std::is_nothrow_destructible<T>::value);
 
-  template <typename U>
-  std::size_t grow(U &&u);
+  template <typename ... Args>
+  std::size_t grow(Args&& ... args);
+
+  void reallocate(std::size_t storage_size);
+
+  void release() noexcept(std::is_nothrow_destructible<T>::value);
+
+  void take_memory(skip_vector &v) noexcept;
+
+  void move_allocator(skip_vector &v, std::true_type) noexcept
+  {
+    static_cast<Allocator&>(*this) = std::move(static_cast<Allocator&>(v));
+  }
+  void move_allocator(skip_vector &, std::false_type) noexcept { }
+
+  void copy_allocator(skip_vector const &v, std::true_type) noexcept
+  {
+    static_cast<Allocator&>(*this) = static_cast<Allocator const&>(v);
+  }
+  void copy_allocator(skip_vector const &, std::false_type) noexcept { }
+
+  // Copies the elements of v to the same slots here, when empty with room
+  // for them.
+  template <typename U = T>
+  std::enable_if_t<std::is_trivially_copyable<U>::value>
+  copy_from(skip_vector const &v) noexcept;
+
+  template <typename U = T>
+  std::enable_if_t<!std::is_trivially_copyable<U>::value>
+  copy_from(skip_vector const &v);
 
   template <typename U = T>
   std::enable_if_t<std::is_standard_layout<U>::value && std::is_trivial<U>::value>
@@ -115,23 +217,139 @@ skip_vector<T, block_size, Allocator>
 template <typename T, std::size_t block_size, typename Allocator>
 skip_vector<T, block_size, Allocator>
 ::skip_vector(skip_vector &&v) noexcept
-    : m_ptr(v.m_ptr)
-    , m_end(v.m_end)
-    , m_storage_size(v.m_storage_size)
+    : Allocator(static_cast<Allocator&>(v))
 {
-  v.m_ptr = nullptr;
+  take_memory(v);
 }
 
 
+template <typename T, std::size_t block_size, typename Allocator>
+skip_vector<T, block_size, Allocator>
+::skip_vector(skip_vector const &v, std::size_t storage_size)
+    : Allocator(A::select_on_container_copy_construction(v))
+{
+  reserve(std::max(storage_size, v.m_end));
+  try
+  {
+    copy_from(v);
+  }
+  catch (...)
+  {
+    release();
+    throw;
+  }
+}
+
 template <typename T, std::size_t block_size, typename Allocator>
 skip_vector<T, block_size, Allocator>::
 ~skip_vector() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  release();
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+skip_vector<T, block_size, Allocator> &
+skip_vector<T, block_size, Allocator>::
+operator=(skip_vector &&v)
+{
+  using propagate = typename A::propagate_on_container_move_assignment;
+  if (this == &v) return *this;
+  if (propagate::value
+      || static_cast<Allocator&>(*this) == static_cast<Allocator&>(v))
+  {
+    release();
+    move_allocator(v, propagate{});
+    take_memory(v);
+    return *this;
+  }
+  clear();
+  reserve(v.m_end);
+  if (v.m_end)
+  {
+    move_to(v.m_ptr, v.m_end, m_ptr);
+  }
+  m_end = v.m_end;
+  v.m_end = 0;
+  return *this;
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+skip_vector<T, block_size, Allocator> &
+skip_vector<T, block_size, Allocator>::
+operator=(skip_vector const &v)
+{
+  using propagate = typename A::propagate_on_container_copy_assignment;
+  if (this == &v) return *this;
+  clear();
+  if (propagate::value
+      && !(static_cast<Allocator&>(*this) == static_cast<Allocator const&>(v)))
+  {
+    release();
+  }
+  copy_allocator(v, propagate{});
+  reserve(v.m_end);
+  copy_from(v);
+  return *this;
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<std::is_trivially_copyable<U>::value>
+skip_vector<T, block_size, Allocator>::
+copy_from(skip_vector const &v) noexcept
+{
+  assert(m_end == 0 && m_storage_size >= v.m_end);
+  if (v.m_end)
+  {
+    std::memcpy(m_ptr, v.m_ptr, v.m_end * sizeof(T));
+  }
+  m_end = v.m_end;
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+template <typename U>
+std::enable_if_t<!std::is_trivially_copyable<U>::value>
+skip_vector<T, block_size, Allocator>::
+copy_from(skip_vector const &v)
+{
+  assert(m_end == 0 && m_storage_size >= v.m_end);
+  for (std::size_t i = 1; i < v.m_end; ++i)
+  {
+    if (rollbear_prio_q_likely(i & block_mask))
+    {
+      A::construct(*this, m_ptr + i, v.m_ptr[i]);
+      m_end = i + 1;
+    }
+  }
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+void
+skip_vector<T, block_size, Allocator>::
+release() noexcept(std::is_nothrow_destructible<T>::value)
 {
   if (m_ptr)
   {
     destroy();
     A::deallocate(*this, m_ptr, m_storage_size);
+    m_ptr = nullptr;
   }
+  m_end = 0;
+  m_storage_size = 0;
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+void
+skip_vector<T, block_size, Allocator>::
+take_memory(skip_vector &v) noexcept
+{
+  m_ptr          = v.m_ptr;
+  m_end          = v.m_end;
+  m_storage_size = v.m_storage_size;
+  v.m_ptr          = nullptr;
+  v.m_end          = 0;
+  v.m_storage_size = 0;
 }
 
 template <typename T, std::size_t block_size, typename Allocator>
@@ -154,6 +372,19 @@ operator[](std::size_t idx) const noexcept
   return m_ptr[idx];
 }
 
+template <typename T, std::size_t block_size, typename Allocator>
+inline
+void
+skip_vector<T, block_size, Allocator>::
+prefetch(std::size_t idx) const noexcept
+{
+#ifdef rollbear_prio_q_prefetch
+  rollbear_prio_q_prefetch(m_ptr + idx);
+#else
+  static_cast<void>(idx);
+#endif
+}
+
 template <typename T, std::size_t block_size, typename Allocator>
 T &
 skip_vector<T, block_size, Allocator>::
@@ -188,23 +419,23 @@ destroy() noexcept(std::is_nothrow_destructible<T>::value)
 }
 
 template <typename T, std::size_t block_size, typename Allocator>
-template <typename U>
+template <typename ... Args>
 std::size_t
 skip_vector<T, block_size, Allocator>::
-push_back(U &&u)
+emplace_back(Args&& ... args)
 {
   if (rollbear_prio_q_likely(m_end & block_mask))
   {
-    A::construct(*this, m_ptr + m_end, std::forward<U>(u));
+    A::construct(*this, m_ptr + m_end, std::forward<Args>(args)...);
     return m_end++;
 
   }
   if (rollbear_prio_q_unlikely(m_end == m_storage_size))
   {
-    return grow(std::forward<U>(u));
+    return grow(std::forward<Args>(args)...);
   }
   m_end++;
-  A::construct(*this, m_ptr + m_end, std::forward<U>(u));
+  A::construct(*this, m_ptr + m_end, std::forward<Args>(args)...);
   return m_end++;
 }
 
@@ -219,17 +450,83 @@ pop_back() noexcept(std::is_nothrow_destructible<T>::value)
 }
 
 template <typename T, std::size_t block_size, typename Allocator>
-template <typename U>
+void
+skip_vector<T, block_size, Allocator>::
+clear() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  if (m_ptr)
+  {
+    destroy();
+  }
+  m_end = 0;
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+void
+skip_vector<T, block_size, Allocator>::
+reserve(std::size_t storage_size)
+{
+  storage_size = (storage_size + block_mask) & ~block_mask;
+  if (storage_size > m_storage_size)
+  {
+    reallocate(storage_size);
+  }
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+void
+skip_vector<T, block_size, Allocator>::
+shrink_to_fit()
+{
+  auto const storage_size = (m_end + block_mask) & ~block_mask;
+  if (storage_size < m_storage_size)
+  {
+    reallocate(storage_size);
+  }
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+void
+skip_vector<T, block_size, Allocator>::
+reallocate(std::size_t storage_size)
+{
+  T *ptr = nullptr;
+  if (storage_size)
+  {
+    ptr = A::allocate(*this, storage_size, m_ptr);
+    if (m_end)
+    {
+      try
+      {
+        move_to(m_ptr, m_end, ptr);
+      }
+      catch (...)
+      {
+        A::deallocate(*this, ptr, storage_size);
+        throw;
+      }
+    }
+  }
+  if (m_ptr)
+  {
+    A::deallocate(*this, m_ptr, m_storage_size);
+  }
+  m_ptr          = ptr;
+  m_storage_size = storage_size;
+}
+
+template <typename T, std::size_t block_size, typename Allocator>
+template <typename ... Args>
 std::size_t
 skip_vector<T, block_size, Allocator>::
-grow(U &&u)
+grow(Args&& ... args)
 {
   auto desired_size = m_storage_size ? m_storage_size * 2 : block_size * 16;
   auto ptr          = A::allocate(*this, desired_size, m_ptr);
   std::size_t idx   = 0;
   try
   {
-    A::construct(*this, ptr + m_end + 1, std::forward<U>(u));
+    A::construct(*this, ptr + m_end + 1, std::forward<Args>(args)...);
     idx = m_end + 1;
     if (m_storage_size)
     {
@@ -244,7 +541,7 @@ grow(U &&u)
   catch (...)
   {
     if (idx != 0) A::destroy(*this, ptr + idx);
-    A::deallocate(*this, ptr, m_storage_size);
+    A::deallocate(*this, ptr, desired_size);
     throw;
   }
 }
@@ -331,146 +628,2660 @@ skip_vector<T, block_size, Allocator>::size() const noexcept
   return m_end;
 }
 
-template <std::size_t blocking>
-struct heap_heap_addressing
+template <typename T, std::size_t block_size, typename Allocator>
+std::size_t
+skip_vector<T, block_size, Allocator>::capacity() const noexcept
 {
-  static const constexpr std::size_t block_size = blocking;
-  static const constexpr std::size_t block_mask = block_size - 1;
-  static_assert((block_size & block_mask) == 0U,
-                "block size must be 2^n for some integer n");
-
-  static std::size_t child_of(std::size_t node_no) noexcept;
-  static std::size_t parent_of(std::size_t node_no) noexcept;
-  static bool        is_block_root(std::size_t node_no) noexcept;
-  static std::size_t block_offset(std::size_t node_no) noexcept;
-  static std::size_t block_base(std::size_t node_no) noexcept;
-  static bool        is_block_leaf(std::size_t node_no) noexcept;
-  static std::size_t child_no(std::size_t node_no) noexcept;
-};
+  return m_storage_size;
+}
 
-template <std::size_t block_size, typename V,
-                                  typename Allocator = std::allocator<V>>
-class payload
+constexpr std::size_t ilog2(std::size_t n)
 {
-public:
-  payload(Allocator const &alloc = Allocator{ }) : m_storage(alloc) { }
-  template <typename U>
-  void push_back(U &&u) { m_storage.push_back(std::forward<U>(u)); }
-  void pop_back() { m_storage.pop_back(); }
-  V &top() { return m_storage[1]; }
-  V &back() { return m_storage.back(); }
-  void store(std::size_t idx, V &&v) { m_storage[idx] = std::move(v); }
-  void move(std::size_t from, std::size_t to)
-  {
-    m_storage[to] = std::move(m_storage[from]);
-  }
-private:
-  skip_vector<V, block_size, Allocator> m_storage;
-};
+  return n < 2 ? 0 : 1 + ilog2(n / 2);
+}
 
-template <std::size_t block_size, typename Allocator>
-class payload<block_size, void, Allocator>
+// The interface of skip_vector, but stored in fixed size segments found
+// through a directory, instead of in one array. Growing allocates one more
+// segment and never moves the elements, so no push_back() is much slower
+// than another, unlike with skip_vector, which copies everything when it
+// doubles. The price is an extra load from the directory on every access.
+template <typename T, std::size_t block_size, std::size_t segment_size,
+          typename Allocator = std::allocator<T>>
+class segmented_skip_vector : private Allocator
 {
+  using A = std::allocator_traits<Allocator>;
+  using directory = std::vector<T*, typename A::template rebind_alloc<T*>>;
+  static constexpr std::size_t block_mask = block_size - 1;
+  static constexpr std::size_t segment_mask = segment_size - 1;
+  static constexpr std::size_t segment_shift = ilog2(segment_size);
+  static_assert((block_size & block_mask) == 0U, "block size must be 2^n");
+  static_assert((segment_size & segment_mask) == 0U, "segment size must be 2^n");
+  static_assert(segment_size >= block_size,
+                "a segment must hold at least one block");
 public:
-  payload(Allocator const & = Allocator{ }) { }
-  constexpr bool back() const { return true; }
-  constexpr void store(std::size_t, bool) const { }
-  constexpr void move(std::size_t, std::size_t) const { }
-  constexpr void pop_back() const { };
-};
+           segmented_skip_vector() noexcept;
+  explicit segmented_skip_vector(Allocator const &alloc) noexcept;
+           segmented_skip_vector(segmented_skip_vector &&v) noexcept;
+           segmented_skip_vector(segmented_skip_vector const &v)
+             : segmented_skip_vector(v, v.m_end) { }
+           segmented_skip_vector(segmented_skip_vector const &v,
+                                 std::size_t storage_size);
 
-} // namespace prio_q_internal
+  ~segmented_skip_vector() noexcept(std::is_nothrow_destructible<T>::value);
 
-template <std::size_t block_size, typename T, typename V,
-                                  typename Compare = std::less<T>,
-                                  typename Allocator = std::allocator<T>>
-class prio_queue : private Compare, private prio_q_internal::payload<block_size, V>
-{
-  using address = prio_q_internal::heap_heap_addressing<block_size>;
-  using P = prio_q_internal::payload<block_size, V>;
-public:
-  prio_queue(Compare const &compare = Compare()) : Compare(compare) { }
-  explicit prio_queue(Compare const &compare, Allocator const &a)
-      : Compare(compare)
-      , m_storage(a) { }
+  // As for skip_vector.
+  segmented_skip_vector &operator=(segmented_skip_vector &&v);
+  segmented_skip_vector &operator=(segmented_skip_vector const &v);
 
-  using value_type = T;
-  using payload_type = V;
+  Allocator get_allocator() const noexcept { return *this; }
 
-  template <typename U, typename X = V>
-  std::enable_if_t<std::is_same<X, void>::value>
-  push(U &&u);
+  T       &operator[](std::size_t idx) noexcept;
+  T const &operator[](std::size_t idx) const noexcept;
 
-  template <typename U, typename X>
-  std::enable_if_t<!std::is_same<X, void>::value>
-  push(U &&key, X &&value);
+  void prefetch(std::size_t idx) const noexcept;
 
-  template <typename U = V>
-  std::enable_if_t<std::is_same<U, void>::value, value_type const &>
-  top() const noexcept;
+  T           &back() noexcept;
+  T const     &back() const noexcept;
 
-  template <typename U = V>
-  std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
-  top() noexcept;
+  template <typename ... Args>
+  std::size_t emplace_back(Args&& ... args);
 
-  void pop() noexcept(std::is_nothrow_destructible<T>::value);
+  template <typename U>
+  std::size_t push_back(U &&u) { return emplace_back(std::forward<U>(u)); }
 
-  template <typename U=V>
-  std::enable_if_t<!std::is_same<U, void>::value>
-  reschedule_top(T t);
+  void        pop_back() noexcept(std::is_nothrow_destructible<T>::value);
 
-  template <typename U=V>
-  std::enable_if_t<std::is_same<U, void>::value>
-  reschedule_top(T t);
+  void        clear() noexcept(std::is_nothrow_destructible<T>::value);
 
-  bool empty() const noexcept;
+  void        reserve(std::size_t storage_size);
+  void        shrink_to_fit();
 
+  bool        empty() const noexcept;
   std::size_t size() const noexcept;
+  std::size_t capacity() const noexcept;
 private:
-  template <typename U>
-  void push_key(U &&key);
+  T *slot(std::size_t idx) const noexcept;
 
-  bool sorts_before(value_type const &lv, value_type const &rv) const noexcept;
+  void add_segment();
+
+  void release() noexcept(std::is_nothrow_destructible<T>::value);
+
+  void move_allocator(segmented_skip_vector &v, std::true_type) noexcept
+  {
+    static_cast<Allocator&>(*this) = std::move(static_cast<Allocator&>(v));
+  }
+  void move_allocator(segmented_skip_vector &, std::false_type) noexcept { }
+
+  void copy_allocator(segmented_skip_vector const &v, std::true_type) noexcept
+  {
+    static_cast<Allocator&>(*this) = static_cast<Allocator const&>(v);
+  }
+  void copy_allocator(segmented_skip_vector const &, std::false_type) noexcept { }
+
+  // As for skip_vector, one segment at a time.
+  template <typename U = T>
+  std::enable_if_t<std::is_trivially_copyable<U>::value>
+  copy_from(segmented_skip_vector const &v) noexcept;
+
+  template <typename U = T>
+  std::enable_if_t<!std::is_trivially_copyable<U>::value>
+  copy_from(segmented_skip_vector const &v);
+
+  template <typename U = T>
+  std::enable_if_t<std::is_standard_layout<U>::value && std::is_trivial<U>::value>
+  destroy() noexcept { }
+
+  template <typename U = T>
+  std::enable_if_t<!std::is_standard_layout<U>::value || !std::is_trivial<U>::value>
+  destroy() noexcept(std::is_nothrow_destructible<T>::value);
 
-  prio_q_internal::skip_vector<T, block_size, Allocator> m_storage;
-  size_t do_reschedule_top(T t) noexcept(noexcept(std::declval<T&>() = std::declval<T&&>()));
+  directory   m_segments;
+  std::size_t m_end = 0;
 };
 
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+segmented_skip_vector() noexcept
+  : segmented_skip_vector(Allocator())
+{
+}
 
-template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
-template <typename U, typename X>
-inline
-std::enable_if_t<std::is_same<X, void>::value>
-prio_queue<block_size, T, V, Compare, Allocator>::
-push(U &&u)
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+segmented_skip_vector(Allocator const &alloc) noexcept
+  : Allocator(alloc)
+  , m_segments(typename directory::allocator_type(alloc))
 {
-  push_key(std::forward<U>(u));
 }
 
-template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
-template <typename U, typename X>
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+segmented_skip_vector(segmented_skip_vector &&v) noexcept
+  : Allocator(static_cast<Allocator&>(v))
+  , m_segments(std::move(v.m_segments))
+  , m_end(v.m_end)
+{
+  v.m_segments.clear();
+  v.m_end = 0;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+segmented_skip_vector(segmented_skip_vector const &v, std::size_t storage_size)
+  : Allocator(A::select_on_container_copy_construction(v))
+  , m_segments(typename directory::allocator_type(static_cast<Allocator&>(*this)))
+{
+  try
+  {
+    reserve(std::max(storage_size, v.m_end));
+    copy_from(v);
+  }
+  catch (...)
+  {
+    release();
+    throw;
+  }
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+~segmented_skip_vector() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  release();
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+segmented_skip_vector<T, block_size, segment_size, Allocator> &
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+operator=(segmented_skip_vector &&v)
+{
+  using propagate = typename A::propagate_on_container_move_assignment;
+  if (this == &v) return *this;
+  if (propagate::value
+      || static_cast<Allocator&>(*this) == static_cast<Allocator&>(v))
+  {
+    release();
+    move_allocator(v, propagate{});
+    m_segments = std::move(v.m_segments);
+    m_end = v.m_end;
+    v.m_segments.clear();
+    v.m_end = 0;
+    return *this;
+  }
+  clear();
+  for (std::size_t i = 1; i < v.m_end; ++i)
+  {
+    if (i & block_mask)
+    {
+      emplace_back(std::move(v[i]));
+    }
+  }
+  v.clear();
+  return *this;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+segmented_skip_vector<T, block_size, segment_size, Allocator> &
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+operator=(segmented_skip_vector const &v)
+{
+  using propagate = typename A::propagate_on_container_copy_assignment;
+  if (this == &v) return *this;
+  clear();
+  if (propagate::value
+      && !(static_cast<Allocator&>(*this) == static_cast<Allocator const&>(v)))
+  {
+    release();
+  }
+  copy_allocator(v, propagate{});
+  reserve(v.m_end);
+  copy_from(v);
+  return *this;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+template <typename U>
+inline
+std::enable_if_t<std::is_trivially_copyable<U>::value>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+copy_from(segmented_skip_vector const &v) noexcept
+{
+  assert(m_end == 0 && capacity() >= v.m_end);
+  for (std::size_t s = 0; s * segment_size < v.m_end; ++s)
+  {
+    auto const n = std::min(segment_size, v.m_end - s * segment_size);
+    std::memcpy(m_segments[s], v.m_segments[s], n * sizeof(T));
+  }
+  m_end = v.m_end;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+template <typename U>
+std::enable_if_t<!std::is_trivially_copyable<U>::value>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+copy_from(segmented_skip_vector const &v)
+{
+  assert(m_end == 0 && capacity() >= v.m_end);
+  for (std::size_t i = 1; i < v.m_end; ++i)
+  {
+    if (rollbear_prio_q_likely(i & block_mask))
+    {
+      A::construct(*this, slot(i), v[i]);
+      m_end = i + 1;
+    }
+  }
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+void
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+release() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  destroy();
+  for (auto segment : m_segments)
+  {
+    A::deallocate(*this, segment, segment_size);
+  }
+  m_segments.clear();
+  m_end = 0;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+T *
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+slot(std::size_t idx) const noexcept
+{
+  return m_segments[idx >> segment_shift] + (idx & segment_mask);
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+T &
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+operator[](std::size_t idx) noexcept
+{
+  assert(idx < m_end);
+  assert((idx & block_mask) != 0);
+  return *slot(idx);
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+T const &
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+operator[](std::size_t idx) const noexcept
+{
+  assert(idx < m_end);
+  assert((idx & block_mask) != 0);
+  return *slot(idx);
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+void
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+prefetch(std::size_t idx) const noexcept
+{
+#ifdef rollbear_prio_q_prefetch
+  rollbear_prio_q_prefetch(slot(idx));
+#else
+  static_cast<void>(idx);
+#endif
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+T &
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+back() noexcept
+{
+  assert(!empty());
+  return *slot(m_end - 1);
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+T const &
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+back() const noexcept
+{
+  assert(!empty());
+  return *slot(m_end - 1);
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+template <typename ... Args>
+inline
+std::size_t
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+emplace_back(Args&& ... args)
+{
+  if (rollbear_prio_q_likely(m_end & block_mask))
+  {
+    A::construct(*this, slot(m_end), std::forward<Args>(args)...);
+    return m_end++;
+  }
+  if (rollbear_prio_q_unlikely(m_end == capacity()))
+  {
+    add_segment();
+  }
+  A::construct(*this, slot(m_end + 1), std::forward<Args>(args)...);
+  m_end += 2;
+  return m_end - 1;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+void
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+pop_back() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  assert(m_end);
+  A::destroy(*this, slot(--m_end));
+  m_end -= (m_end & block_mask) == 1;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+void
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+clear() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  destroy();
+  m_end = 0;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+void
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+reserve(std::size_t storage_size)
+{
+  auto const num_segments = (storage_size + segment_mask) >> segment_shift;
+  m_segments.reserve(num_segments);
+  while (m_segments.size() < num_segments)
+  {
+    add_segment();
+  }
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+void
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+shrink_to_fit()
+{
+  auto const num_segments = (m_end + segment_mask) >> segment_shift;
+  while (m_segments.size() > num_segments)
+  {
+    A::deallocate(*this, m_segments.back(), segment_size);
+    m_segments.pop_back();
+  }
+  m_segments.shrink_to_fit();
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+bool
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+empty() const noexcept
+{
+  return m_end == 0;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+std::size_t
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+size() const noexcept
+{
+  return m_end;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+inline
+std::size_t
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+capacity() const noexcept
+{
+  return m_segments.size() * segment_size;
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+void
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+add_segment()
+{
+  auto segment = A::allocate(*this, segment_size);
+  try
+  {
+    m_segments.push_back(segment);
+  }
+  catch (...)
+  {
+    A::deallocate(*this, segment, segment_size);
+    throw;
+  }
+}
+
+template <typename T, std::size_t block_size, std::size_t segment_size, typename Allocator>
+template <typename U>
+std::enable_if_t<!std::is_standard_layout<U>::value || !std::is_trivial<U>::value>
+segmented_skip_vector<T, block_size, segment_size, Allocator>::
+destroy() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  auto i = m_end;
+  while (rollbear_prio_q_unlikely(i-- != 0))
+  {
+    if (rollbear_prio_q_likely(i & block_mask))
+    {
+      A::destroy(*this, slot(i));
+    }
+  }
+}
+
+// The largest power of 2 that is at most n, or 1.
+constexpr std::size_t floor_pow2(std::size_t n)
+{
+  return n < 2 ? 1 : 2 * floor_pow2(n / 2);
+}
+
+template <typename T, typename V, std::size_t group_size>
+struct interleaved_group
+{
+  std::aligned_storage_t<sizeof(T), alignof(T)> keys[group_size];
+  std::aligned_storage_t<sizeof(V), alignof(V)> values[group_size];
+};
+
+template <typename Vector>
+class interleaved_values;
+
+// Keys and payloads in one array, where every group of group_size adjacent
+// slots is their keys followed by their payloads. With the group the size of
+// a block, a block is its keys and then its payloads, and with a smaller
+// group, a cache line can hold both the keys and the payloads of its slots.
+//
+// It has the interface of skip_vector for the keys, and values() gives the
+// interface of a payload store. The payloads have an end of their own, so
+// keys and payloads can be pushed and popped in either order.
+template <typename T, typename V, std::size_t block_size,
+          std::size_t group_size, typename Allocator = std::allocator<T>>
+class interleaved_skip_vector
+  : private std::allocator_traits<Allocator>::template rebind_alloc<
+      interleaved_group<T, V, group_size>>
+{
+  using group = interleaved_group<T, V, group_size>;
+  using GA = typename std::allocator_traits<Allocator>::template rebind_alloc<group>;
+  using A = std::allocator_traits<GA>;
+  static constexpr std::size_t block_mask = block_size - 1;
+  static constexpr std::size_t group_mask = group_size - 1;
+  static constexpr std::size_t group_shift = ilog2(group_size);
+  static constexpr std::size_t granularity = block_size > group_size
+                                             ? block_size : group_size;
+  static constexpr bool nothrow_destructible
+    = std::is_nothrow_destructible<T>::value
+      && std::is_nothrow_destructible<V>::value;
+  static_assert((block_size & block_mask) == 0U, "block size must be 2^n");
+  static_assert((group_size & group_mask) == 0U, "group size must be 2^n");
+  friend class interleaved_values<interleaved_skip_vector>;
+  friend class interleaved_values<interleaved_skip_vector const>;
+public:
+  using payload_type = V;
+
+  // Whether the keys of a block are adjacent, as in a skip_vector.
+  static constexpr bool contiguous_blocks = group_size >= block_size;
+
+           interleaved_skip_vector() noexcept;
+  explicit interleaved_skip_vector(Allocator const &alloc) noexcept;
+           interleaved_skip_vector(interleaved_skip_vector &&v) noexcept;
+           interleaved_skip_vector(interleaved_skip_vector const &v)
+             : interleaved_skip_vector(v, 0) { }
+           interleaved_skip_vector(interleaved_skip_vector const &v,
+                                   std::size_t storage_size);
+
+  ~interleaved_skip_vector() noexcept(nothrow_destructible);
+
+  // As for skip_vector.
+  interleaved_skip_vector &operator=(interleaved_skip_vector &&v);
+  interleaved_skip_vector &operator=(interleaved_skip_vector const &v);
+
+  Allocator get_allocator() const noexcept
+  {
+    return Allocator(static_cast<GA const&>(*this));
+  }
+
+  T       &operator[](std::size_t idx) noexcept;
+  T const &operator[](std::size_t idx) const noexcept;
+
+  void prefetch(std::size_t idx) const noexcept;
+
+  T           &back() noexcept;
+  T const     &back() const noexcept;
+
+  template <typename ... Args>
+  std::size_t emplace_back(Args&& ... args);
+
+  template <typename U>
+  std::size_t push_back(U &&u) { return emplace_back(std::forward<U>(u)); }
+
+  void        pop_back() noexcept(std::is_nothrow_destructible<T>::value);
+
+  void        clear() noexcept(std::is_nothrow_destructible<T>::value);
+
+  void        reserve(std::size_t storage_size);
+  void        shrink_to_fit();
+
+  bool        empty() const noexcept;
+  std::size_t size() const noexcept;
+  std::size_t capacity() const noexcept;
+
+  interleaved_values<interleaved_skip_vector> values() noexcept;
+  interleaved_values<interleaved_skip_vector const> values() const noexcept;
+private:
+  T *key(std::size_t idx) const noexcept;
+  V *value(std::size_t idx) const noexcept;
+
+  static std::size_t slot_after(std::size_t end) noexcept;
+
+  template <typename ... Args>
+  void emplace_value(Args&& ... args);
+
+  void pop_value() noexcept(std::is_nothrow_destructible<V>::value);
+
+  void clear_values() noexcept(std::is_nothrow_destructible<V>::value);
+
+  void make_room(std::size_t idx);
+
+  void reallocate(std::size_t storage_size);
+
+  void release() noexcept(nothrow_destructible);
+
+  void take_memory(interleaved_skip_vector &v) noexcept;
+
+  void move_allocator(interleaved_skip_vector &v, std::true_type) noexcept
+  {
+    static_cast<GA&>(*this) = std::move(static_cast<GA&>(v));
+  }
+  void move_allocator(interleaved_skip_vector &, std::false_type) noexcept { }
+
+  void copy_allocator(interleaved_skip_vector const &v, std::true_type) noexcept
+  {
+    static_cast<GA&>(*this) = static_cast<GA const&>(v);
+  }
+  void copy_allocator(interleaved_skip_vector const &, std::false_type) noexcept { }
+
+  // As for skip_vector, with the keys and payloads together.
+  template <typename U = T, typename X = V>
+  std::enable_if_t<std::is_trivially_copyable<U>::value
+                   && std::is_trivially_copyable<X>::value>
+  copy_from(interleaved_skip_vector const &v) noexcept;
+
+  template <typename U = T, typename X = V>
+  std::enable_if_t<!std::is_trivially_copyable<U>::value
+                   || !std::is_trivially_copyable<X>::value>
+  copy_from(interleaved_skip_vector const &v);
+
+  group       *m_ptr          = nullptr;
+  std::size_t m_end           = 0;
+  std::size_t m_values_end    = 0;
+  std::size_t m_storage_size  = 0;
+};
+
+// The payload store of an interleaved_skip_vector. The memory is the
+// vector's, and is reserved and shrunk through it.
+template <typename Vector>
+class interleaved_values
+{
+  using V = typename std::remove_const_t<Vector>::payload_type;
+public:
+  interleaved_values(Vector *v) noexcept : m_v(v) { }
+  template <typename U>
+  void push_back(U &&u) { m_v->emplace_value(std::forward<U>(u)); }
+  template <typename ... Args>
+  void emplace_back(Args&& ... args)
+  {
+    m_v->emplace_value(std::forward<Args>(args)...);
+  }
+  void pop_back() { m_v->pop_value(); }
+  void clear() { m_v->clear_values(); }
+  void reserve(std::size_t) const noexcept { }
+  void shrink_to_fit() const noexcept { }
+  V &top() { return *m_v->value(1); }
+  V &back() { return *m_v->value(m_v->m_values_end - 1); }
+  V &get(std::size_t idx) { return *m_v->value(idx); }
+  void prefetch(std::size_t idx) const noexcept
+  {
+#ifdef rollbear_prio_q_prefetch
+    rollbear_prio_q_prefetch(m_v->value(idx));
+#else
+    static_cast<void>(idx);
+#endif
+  }
+  void store(std::size_t idx, V &&v) { get(idx) = std::move(v); }
+  void move(std::size_t from, std::size_t to)
+  {
+    get(to) = std::move(get(from));
+  }
+private:
+  Vector *m_v;
+};
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+interleaved_skip_vector() noexcept
+  : interleaved_skip_vector(Allocator())
+{
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+interleaved_skip_vector(Allocator const &alloc) noexcept
+  : GA(alloc)
+{
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+interleaved_skip_vector(interleaved_skip_vector &&v) noexcept
+  : GA(static_cast<GA&>(v))
+{
+  take_memory(v);
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+interleaved_skip_vector(interleaved_skip_vector const &v, std::size_t storage_size)
+  : GA(A::select_on_container_copy_construction(v))
+{
+  reserve(std::max(storage_size, std::max(v.m_end, v.m_values_end)));
+  try
+  {
+    copy_from(v);
+  }
+  catch (...)
+  {
+    release();
+    throw;
+  }
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+~interleaved_skip_vector() noexcept(nothrow_destructible)
+{
+  release();
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator> &
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+operator=(interleaved_skip_vector &&v)
+{
+  using propagate = typename A::propagate_on_container_move_assignment;
+  if (this == &v) return *this;
+  if (propagate::value || static_cast<GA&>(*this) == static_cast<GA&>(v))
+  {
+    release();
+    move_allocator(v, propagate{});
+    take_memory(v);
+    return *this;
+  }
+  clear();
+  clear_values();
+  reserve(std::max(v.m_end, v.m_values_end));
+  for (std::size_t i = 1; i < v.m_end; ++i)
+  {
+    if (i & block_mask) emplace_back(std::move(*v.key(i)));
+  }
+  for (std::size_t i = 1; i < v.m_values_end; ++i)
+  {
+    if (i & block_mask) emplace_value(std::move(*v.value(i)));
+  }
+  v.clear();
+  v.clear_values();
+  return *this;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator> &
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+operator=(interleaved_skip_vector const &v)
+{
+  using propagate = typename A::propagate_on_container_copy_assignment;
+  if (this == &v) return *this;
+  clear();
+  clear_values();
+  if (propagate::value
+      && !(static_cast<GA&>(*this) == static_cast<GA const&>(v)))
+  {
+    release();
+  }
+  copy_allocator(v, propagate{});
+  reserve(std::max(v.m_end, v.m_values_end));
+  copy_from(v);
+  return *this;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_trivially_copyable<U>::value
+                 && std::is_trivially_copyable<X>::value>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+copy_from(interleaved_skip_vector const &v) noexcept
+{
+  auto const end = std::max(v.m_end, v.m_values_end);
+  assert(m_end == 0 && m_values_end == 0 && m_storage_size >= end);
+  if (end)
+  {
+    auto const groups = (end + group_mask) >> group_shift;
+    std::memcpy(m_ptr, v.m_ptr, groups * sizeof(group));
+  }
+  m_end = v.m_end;
+  m_values_end = v.m_values_end;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+template <typename U, typename X>
+std::enable_if_t<!std::is_trivially_copyable<U>::value
+                 || !std::is_trivially_copyable<X>::value>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+copy_from(interleaved_skip_vector const &v)
+{
+  assert(m_end == 0 && m_values_end == 0
+         && m_storage_size >= std::max(v.m_end, v.m_values_end));
+  for (std::size_t i = 1; i < v.m_end; ++i)
+  {
+    if (!(i & block_mask)) continue;
+    A::construct(*this, key(i), *v.key(i));
+    m_end = i + 1;
+  }
+  for (std::size_t i = 1; i < v.m_values_end; ++i)
+  {
+    if (!(i & block_mask)) continue;
+    A::construct(*this, value(i), *v.value(i));
+    m_values_end = i + 1;
+  }
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+T &
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+operator[](std::size_t idx) noexcept
+{
+  assert(idx < m_end);
+  assert((idx & block_mask) != 0);
+  return *key(idx);
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+T const &
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+operator[](std::size_t idx) const noexcept
+{
+  assert(idx < m_end);
+  assert((idx & block_mask) != 0);
+  return *key(idx);
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+prefetch(std::size_t idx) const noexcept
+{
+#ifdef rollbear_prio_q_prefetch
+  rollbear_prio_q_prefetch(key(idx));
+#else
+  static_cast<void>(idx);
+#endif
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+T &
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+back() noexcept
+{
+  assert(!empty());
+  return *key(m_end - 1);
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+T const &
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+back() const noexcept
+{
+  assert(!empty());
+  return *key(m_end - 1);
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+template <typename ... Args>
+inline
+std::size_t
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+emplace_back(Args&& ... args)
+{
+  auto const idx = slot_after(m_end);
+  if (rollbear_prio_q_unlikely(idx >= m_storage_size))
+  {
+    // The arguments may refer to elements, that the reallocation moves.
+    T t(std::forward<Args>(args)...);
+    make_room(idx);
+    A::construct(*this, key(idx), std::move(t));
+  }
+  else
+  {
+    A::construct(*this, key(idx), std::forward<Args>(args)...);
+  }
+  m_end = idx + 1;
+  return idx;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+template <typename ... Args>
+inline
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+emplace_value(Args&& ... args)
+{
+  auto const idx = slot_after(m_values_end);
+  if (rollbear_prio_q_unlikely(idx >= m_storage_size))
+  {
+    V v(std::forward<Args>(args)...);
+    make_room(idx);
+    A::construct(*this, value(idx), std::move(v));
+  }
+  else
+  {
+    A::construct(*this, value(idx), std::forward<Args>(args)...);
+  }
+  m_values_end = idx + 1;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+pop_back() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  assert(m_end);
+  A::destroy(*this, key(--m_end));
+  m_end -= (m_end & block_mask) == 1;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+pop_value() noexcept(std::is_nothrow_destructible<V>::value)
+{
+  assert(m_values_end);
+  A::destroy(*this, value(--m_values_end));
+  m_values_end -= (m_values_end & block_mask) == 1;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+clear() noexcept(std::is_nothrow_destructible<T>::value)
+{
+  if (std::is_trivially_destructible<T>::value) m_end = 0;
+  while (m_end) pop_back();
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+clear_values() noexcept(std::is_nothrow_destructible<V>::value)
+{
+  if (std::is_trivially_destructible<V>::value) m_values_end = 0;
+  while (m_values_end) pop_value();
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+reserve(std::size_t storage_size)
+{
+  storage_size = (storage_size + granularity - 1) & ~(granularity - 1);
+  if (storage_size > m_storage_size)
+  {
+    reallocate(storage_size);
+  }
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+shrink_to_fit()
+{
+  auto const end = std::max(m_end, m_values_end);
+  auto const storage_size = (end + granularity - 1) & ~(granularity - 1);
+  if (storage_size < m_storage_size)
+  {
+    reallocate(storage_size);
+  }
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+bool
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+empty() const noexcept
+{
+  return size() == 0;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+std::size_t
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+size() const noexcept
+{
+  return m_end;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+std::size_t
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+capacity() const noexcept
+{
+  return m_storage_size;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+interleaved_values<interleaved_skip_vector<T, V, block_size, group_size, Allocator>>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+values() noexcept
+{
+  return { this };
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+interleaved_values<interleaved_skip_vector<T, V, block_size, group_size, Allocator> const>
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+values() const noexcept
+{
+  return { this };
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+T *
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+key(std::size_t idx) const noexcept
+{
+  return reinterpret_cast<T*>(&m_ptr[idx >> group_shift].keys[idx & group_mask]);
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+V *
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+value(std::size_t idx) const noexcept
+{
+  return reinterpret_cast<V*>(&m_ptr[idx >> group_shift].values[idx & group_mask]);
+}
+
+// The slot to push to, when the last is end - 1, skipping the unused first
+// slot of every block.
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+inline
+std::size_t
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+slot_after(std::size_t end) noexcept
+{
+  return end + ((end & block_mask) == 0);
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+make_room(std::size_t idx)
+{
+  auto const needed = (idx + granularity) & ~(granularity - 1);
+  auto const doubled = m_storage_size ? m_storage_size * 2 : block_size * 16;
+  reallocate(std::max(needed, doubled));
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+reallocate(std::size_t storage_size)
+{
+  group *ptr = nullptr;
+  if (storage_size)
+  {
+    ptr = A::allocate(*this, storage_size / group_size);
+    // If a constructor throws, to destroys what it got and deallocates ptr,
+    // and the elements here are as they were, unless moves can throw.
+    interleaved_skip_vector to(static_cast<GA&>(*this));
+    to.m_ptr = ptr;
+    to.m_storage_size = storage_size;
+    for (std::size_t i = 1; i < m_end; ++i)
+    {
+      if (!(i & block_mask)) continue;
+      A::construct(*this, to.key(i), std::move_if_noexcept(*key(i)));
+      to.m_end = i + 1;
+    }
+    for (std::size_t i = 1; i < m_values_end; ++i)
+    {
+      if (!(i & block_mask)) continue;
+      A::construct(*this, to.value(i), std::move_if_noexcept(*value(i)));
+      to.m_values_end = i + 1;
+    }
+    to.m_ptr = nullptr;
+    to.m_end = 0;
+    to.m_values_end = 0;
+    to.m_storage_size = 0;
+  }
+  auto const end = m_end;
+  auto const values_end = m_values_end;
+  release();
+  m_ptr          = ptr;
+  m_end          = end;
+  m_values_end   = values_end;
+  m_storage_size = storage_size;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+release() noexcept(nothrow_destructible)
+{
+  if (m_ptr)
+  {
+    clear();
+    clear_values();
+    A::deallocate(*this, m_ptr, m_storage_size / group_size);
+    m_ptr = nullptr;
+  }
+  m_end = 0;
+  m_values_end = 0;
+  m_storage_size = 0;
+}
+
+template <typename T, typename V, std::size_t block_size, std::size_t group_size,
+          typename Allocator>
+void
+interleaved_skip_vector<T, V, block_size, group_size, Allocator>::
+take_memory(interleaved_skip_vector &v) noexcept
+{
+  m_ptr          = v.m_ptr;
+  m_end          = v.m_end;
+  m_values_end   = v.m_values_end;
+  m_storage_size = v.m_storage_size;
+  v.m_ptr          = nullptr;
+  v.m_end          = 0;
+  v.m_values_end   = 0;
+  v.m_storage_size = 0;
+}
+
+} // namespace prio_q_internal
+
+// Storage policies for prio_queue<>, that decide how the keys and the
+// payloads are laid out in memory.
+
+// One array, that doubles and moves all elements when full. The fastest to
+// access, and the default.
+struct contiguous_storage
+{
+  template <typename T, std::size_t block_size, typename Allocator>
+  using vector = prio_q_internal::skip_vector<T, block_size, Allocator>;
+};
+
+// Fixed size segments of segment_size slots, that are never moved, for
+// bounded push() latency at the cost of an indirection on every access.
+// segment_size must be a power of 2, and at least the block size.
+template <std::size_t segment_size = 4096>
+struct segmented_storage
+{
+  template <typename T, std::size_t block_size, typename Allocator>
+  using vector = prio_q_internal::segmented_skip_vector<T, block_size,
+                                                        segment_size,
+                                                        Allocator>;
+};
+
+// Each block as its keys followed by their payloads, in one array that
+// doubles like contiguous_storage, so a pop() walks one allocation instead
+// of two. Only small payloads gain from it, since larger ones spread the
+// keys over more cache lines.
+struct block_interleaved_storage
+{
+  // Used for the keys when there is no payload.
+  template <typename T, std::size_t block_size, typename Allocator>
+  using vector = prio_q_internal::skip_vector<T, block_size, Allocator>;
+
+  template <typename T, typename V, std::size_t block_size, typename Allocator>
+  using interleaved_vector
+    = prio_q_internal::interleaved_skip_vector<T, V, block_size, block_size,
+                                               Allocator>;
+};
+
+// Every line of line_size bytes holds the keys of as many adjacent slots as
+// fit, rounded down to a power of 2, followed by their payloads, so a key
+// shares its cache line with its payload. The keys of a block are then not
+// adjacent, unless the block fits in a line, and the vectorized child
+// selection is not used.
+template <std::size_t line_size = 64>
+struct line_interleaved_storage
+{
+  template <typename T, std::size_t block_size, typename Allocator>
+  using vector = prio_q_internal::skip_vector<T, block_size, Allocator>;
+
+  template <typename T, typename V, std::size_t block_size, typename Allocator>
+  using interleaved_vector
+    = prio_q_internal::interleaved_skip_vector<
+        T, V, block_size,
+        prio_q_internal::floor_pow2(line_size / (sizeof(T) + sizeof(V))),
+        Allocator>;
+};
+
+namespace prio_q_internal
+{
+
+// Each block is a d-ary tree rooted at offset 1, where the children of the
+// node at offset o have the offsets arity * (o - 1) + 2 and up. Children that
+// would fall outside the block are instead the roots of child blocks, so
+// every block has fanout child blocks, and the children of block b are the
+// blocks b * fanout + 1 and up. With arity 2, the children of a node are
+// either both in its own block, or both block roots. Blocks of 2 hold a
+// single node, whose children are always block roots, and are binary.
+template <std::size_t blocking, std::size_t d = 2>
+struct heap_heap_addressing
+{
+  static const constexpr std::size_t block_size = blocking;
+  static const constexpr std::size_t block_mask = block_size - 1;
+  static const constexpr std::size_t arity = d;
+  static const constexpr std::size_t fanout = (arity - 1) * (block_size - 1) + 1;
+  static_assert((block_size & block_mask) == 0U,
+                "block size must be 2^n for some integer n");
+  static_assert(arity >= 2 && (arity <= block_size / 2 || (arity == 2 && block_size == 2)),
+                "arity must be at least 2 and at most half the block size");
+
+  static std::size_t child_of(std::size_t node_no) noexcept;
+  static std::size_t next_sibling(std::size_t node_no) noexcept;
+  static std::size_t parent_of(std::size_t node_no) noexcept;
+  static bool        is_block_root(std::size_t node_no) noexcept;
+  static std::size_t block_offset(std::size_t node_no) noexcept;
+  static std::size_t block_base(std::size_t node_no) noexcept;
+  static bool        is_block_leaf(std::size_t node_no) noexcept;
+  static bool        children_in_block(std::size_t node_no) noexcept;
+private:
+  static std::size_t child_block_root(std::size_t node_no, std::size_t child) noexcept;
+};
+
+// The allocator for the payloads, from the allocator for the keys.
+template <typename Allocator, typename V>
+struct payload_allocator
+{
+  using type = typename std::allocator_traits<Allocator>::template rebind_alloc<V>;
+};
+
+template <typename Allocator>
+struct payload_allocator<Allocator, void>
+{
+  using type = Allocator;
+};
+
+// The allocator that storage vector v was made with, or a default one for
+// storage that never takes its memory from an allocator.
+template <typename Allocator, typename Vector>
+auto storage_allocator(Vector const &v, int) -> decltype(Allocator(v.get_allocator()))
+{
+  return Allocator(v.get_allocator());
+}
+
+template <typename Allocator, typename Vector>
+Allocator storage_allocator(Vector const &, long)
+{
+  return Allocator();
+}
+
+template <typename V>
+struct payload_size : std::integral_constant<std::size_t, sizeof(V)> {};
+
+template <>
+struct payload_size<void> : std::integral_constant<std::size_t, 0> {};
+
+template <std::size_t block_size, typename V,
+                                  typename Allocator = std::allocator<V>,
+                                  typename Storage = contiguous_storage>
+class payload
+{
+public:
+  using allocator_type = Allocator;
+  payload(Allocator const &alloc = Allocator{ }) : m_storage(alloc) { }
+  payload(payload const &p, std::size_t storage_size)
+    : m_storage(p.m_storage, storage_size) { }
+  template <typename U>
+  void push_back(U &&u) { m_storage.push_back(std::forward<U>(u)); }
+  template <typename ... Args>
+  void emplace_back(Args&& ... args)
+  {
+    m_storage.emplace_back(std::forward<Args>(args)...);
+  }
+  void pop_back() { m_storage.pop_back(); }
+  void clear() { m_storage.clear(); }
+  void reserve(std::size_t s) { m_storage.reserve(s); }
+  void shrink_to_fit() { m_storage.shrink_to_fit(); }
+  V &top() { return m_storage[1]; }
+  V &back() { return m_storage.back(); }
+  V &get(std::size_t idx) { return m_storage[idx]; }
+  V const &get(std::size_t idx) const { return m_storage[idx]; }
+  void prefetch(std::size_t idx) const noexcept { m_storage.prefetch(idx); }
+  void store(std::size_t idx, V &&v) { m_storage[idx] = std::move(v); }
+  void move(std::size_t from, std::size_t to)
+  {
+    m_storage[to] = std::move(m_storage[from]);
+  }
+private:
+  typename Storage::template vector<V, block_size, Allocator> m_storage;
+};
+
+template <std::size_t block_size, typename Allocator, typename Storage>
+class payload<block_size, void, Allocator, Storage>
+{
+public:
+  using allocator_type = Allocator;
+  payload(Allocator const & = Allocator{ }) { }
+  payload(payload const &, std::size_t) { }
+  constexpr void push_back(bool) const { }
+  constexpr void clear() const { }
+  constexpr void reserve(std::size_t) const { }
+  constexpr void shrink_to_fit() const { }
+  constexpr bool back() const { return true; }
+  constexpr bool get(std::size_t) const { return true; }
+  constexpr void prefetch(std::size_t) const noexcept { }
+  constexpr void store(std::size_t, bool) const { }
+  constexpr void move(std::size_t, std::size_t) const { }
+  constexpr void pop_back() const { };
+};
+
+template <typename T>
+struct always_void
+{
+  using type = void;
+};
+
+// The key vector and the payload store of a prio_queue<>. They are apart,
+// unless the storage policy has an interleaved_vector, which is then both.
+template <std::size_t block_size, typename T, typename V, typename Allocator,
+          typename Storage, typename = void>
+struct layout
+{
+  using keys = typename Storage::template vector<T, block_size, Allocator>;
+  using payloads = payload<block_size, V,
+                           typename payload_allocator<Allocator, V>::type,
+                           Storage>;
+  static constexpr bool interleaved = false;
+  static constexpr bool contiguous_blocks = true;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Allocator,
+          typename Storage>
+struct layout<block_size, T, V, Allocator, Storage,
+              std::enable_if_t<
+                !std::is_same<V, void>::value,
+                typename always_void<
+                  typename Storage::template interleaved_vector<
+                    T, V, block_size, Allocator>>::type>>
+{
+  using keys = typename Storage::template interleaved_vector<T, V, block_size,
+                                                             Allocator>;
+  using payloads = payload<block_size, void, Allocator, Storage>;
+  static constexpr bool interleaved = true;
+  static constexpr bool contiguous_blocks = keys::contiguous_blocks;
+};
+
+// The header of a snapshot written by prio_queue<>::save(), in the byte
+// order of the machine that wrote it. The keys and payloads follow, in their
+// heap order, as runs of the keys of up to snapshot_chunk elements, each
+// followed by the run of their payloads, and last a 64 bit checksum of the
+// header and the runs, so that the snapshot is written in one pass.
+struct snapshot_header
+{
+  std::uint64_t magic;
+  std::uint64_t version;
+  std::uint64_t block_size;
+  std::uint64_t arity;
+  std::uint64_t key_size;
+  std::uint64_t payload_size;
+  std::uint64_t count;
+};
+
+constexpr std::uint64_t snapshot_magic = 0x7172706f6972707eULL;
+constexpr std::uint64_t snapshot_version = 2;
+constexpr std::size_t snapshot_chunk = 4096;
+
+template <typename V>
+struct snapshot_copyable : std::is_trivially_copyable<V> {};
+
+template <>
+struct snapshot_copyable<void> : std::true_type {};
+
+// A checksum of the header and runs of a snapshot, a word at a time, so that it costs
+// little next to the I/O.
+class snapshot_checksum
+{
+public:
+  void add(unsigned char const *p, std::size_t n) noexcept
+  {
+    for (; n >= sizeof(std::uint64_t); p += sizeof(std::uint64_t), n -= sizeof(std::uint64_t))
+    {
+      std::uint64_t w;
+      std::memcpy(&w, p, sizeof(w));
+      mix(w);
+    }
+    if (n)
+    {
+      std::uint64_t w = n;
+      std::memcpy(&w, p, n);
+      mix(w);
+    }
+  }
+  std::uint64_t value() const noexcept { return m_sum ^ (m_sum >> 29); }
+private:
+  void mix(std::uint64_t w) noexcept { m_sum = (m_sum ^ w) * 0x100000001b3ULL; }
+  std::uint64_t m_sum = 0xcbf29ce484222325ULL;
+};
+
+// An object of trivially copyable type T, from its bytes.
+template <typename T>
+T snapshot_value(unsigned char const *p) noexcept
+{
+  std::aligned_storage_t<sizeof(T), alignof(T)> raw;
+  std::memcpy(&raw, p, sizeof(T));
+  return reinterpret_cast<T const&>(raw);
+}
+
+// Which way Compare orders arithmetic keys. -1 when the smallest key sorts
+// first, 1 when the largest does, and 0 when it can't be told.
+template <typename T, typename Compare>
+struct key_order : std::integral_constant<int, 0> {};
+
+template <typename T>
+struct key_order<T, std::less<T>> : std::integral_constant<int, -1> {};
+
+template <typename T>
+struct key_order<T, std::less<>> : std::integral_constant<int, -1> {};
+
+template <typename T>
+struct key_order<T, std::greater<T>> : std::integral_constant<int, 1> {};
+
+template <typename T>
+struct key_order<T, std::greater<>> : std::integral_constant<int, 1> {};
+
+// Finds the index of the best of n contiguous keys with vector compares,
+// the first one of them if several are equally good. The ISA is chosen at
+// compile time, so build with e.g. -mavx2 or -march=native to use it. In
+// the general case it is not enabled, and the children are compared one by
+// one. That is also the case for fewer than 8 keys, where the reduction
+// takes as long as the scalar compares.
+template <typename T, std::size_t n, int order>
+struct simd_best_of
+{
+  static const constexpr bool enabled = false;
+  static std::size_t index(T const *) noexcept { return 0; }
+};
+
+#ifdef rollbear_prio_q_simd
+
+inline
+std::size_t first_set(unsigned mask) noexcept
+{
+  return static_cast<std::size_t>(__builtin_ctz(mask));
+}
+
+template <int order>
+struct simd_best_of<std::int32_t, 8, order>
+{
+  static const constexpr bool enabled = order != 0;
+  static std::size_t index(std::int32_t const *p) noexcept
+  {
+    auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(p));
+    auto best = pick(v, _mm256_permute2x128_si256(v, v, 1));
+    best = pick(best, _mm256_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = pick(best, _mm256_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+    auto const eq = _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, best));
+    return first_set(static_cast<unsigned>(_mm256_movemask_ps(eq)));
+  }
+private:
+  static __m256i pick(__m256i a, __m256i b) noexcept
+  {
+    return order < 0 ? _mm256_min_epi32(a, b) : _mm256_max_epi32(a, b);
+  }
+};
+
+template <int order>
+struct simd_best_of<float, 8, order>
+{
+  static const constexpr bool enabled = order != 0;
+  static std::size_t index(float const *p) noexcept
+  {
+    auto const v = _mm256_loadu_ps(p);
+    auto best = pick(v, _mm256_permute2f128_ps(v, v, 1));
+    best = pick(best, _mm256_shuffle_ps(best, best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = pick(best, _mm256_shuffle_ps(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+    auto const eq = _mm256_cmp_ps(v, best, _CMP_EQ_OQ);
+    return first_set(static_cast<unsigned>(_mm256_movemask_ps(eq)));
+  }
+private:
+  static __m256 pick(__m256 a, __m256 b) noexcept
+  {
+    return order < 0 ? _mm256_min_ps(a, b) : _mm256_max_ps(a, b);
+  }
+};
+
+#ifdef __AVX512F__
+
+template <int order>
+struct simd_best_of<std::int32_t, 16, order>
+{
+  static const constexpr bool enabled = order != 0;
+  static std::size_t index(std::int32_t const *p) noexcept
+  {
+    auto const v = _mm512_loadu_si512(p);
+    auto best = pick(v, _mm512_shuffle_i32x4(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = pick(best, _mm512_shuffle_i32x4(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+    best = pick(best, _mm512_shuffle_epi32(best, _MM_PERM_BADC));
+    best = pick(best, _mm512_shuffle_epi32(best, _MM_PERM_CDAB));
+    return first_set(_mm512_cmpeq_epi32_mask(v, best));
+  }
+private:
+  static __m512i pick(__m512i a, __m512i b) noexcept
+  {
+    return order < 0 ? _mm512_min_epi32(a, b) : _mm512_max_epi32(a, b);
+  }
+};
+
+template <int order>
+struct simd_best_of<std::int64_t, 8, order>
+{
+  static const constexpr bool enabled = order != 0;
+  static std::size_t index(std::int64_t const *p) noexcept
+  {
+    auto const v = _mm512_loadu_si512(p);
+    auto best = pick(v, _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = pick(best, _mm512_shuffle_i64x2(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+    best = pick(best, _mm512_shuffle_epi32(best, _MM_PERM_BADC));
+    return first_set(_mm512_cmpeq_epi64_mask(v, best));
+  }
+private:
+  static __m512i pick(__m512i a, __m512i b) noexcept
+  {
+    return order < 0 ? _mm512_min_epi64(a, b) : _mm512_max_epi64(a, b);
+  }
+};
+
+template <int order>
+struct simd_best_of<float, 16, order>
+{
+  static const constexpr bool enabled = order != 0;
+  static std::size_t index(float const *p) noexcept
+  {
+    auto const v = _mm512_loadu_ps(p);
+    auto best = pick(v, _mm512_shuffle_f32x4(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = pick(best, _mm512_shuffle_f32x4(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+    best = pick(best, _mm512_shuffle_ps(best, best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = pick(best, _mm512_shuffle_ps(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+    return first_set(_mm512_cmp_ps_mask(v, best, _CMP_EQ_OQ));
+  }
+private:
+  static __m512 pick(__m512 a, __m512 b) noexcept
+  {
+    return order < 0 ? _mm512_min_ps(a, b) : _mm512_max_ps(a, b);
+  }
+};
+
+template <int order>
+struct simd_best_of<double, 8, order>
+{
+  static const constexpr bool enabled = order != 0;
+  static std::size_t index(double const *p) noexcept
+  {
+    auto const v = _mm512_loadu_pd(p);
+    auto best = pick(v, _mm512_shuffle_f64x2(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = pick(best, _mm512_shuffle_f64x2(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+    best = pick(best, _mm512_shuffle_pd(best, best, 0x55));
+    return first_set(_mm512_cmp_pd_mask(v, best, _CMP_EQ_OQ));
+  }
+private:
+  static __m512d pick(__m512d a, __m512d b) noexcept
+  {
+    return order < 0 ? _mm512_min_pd(a, b) : _mm512_max_pd(a, b);
+  }
+};
+
+#endif // __AVX512F__
+
+#endif // rollbear_prio_q_simd
+
+// An element moved out of a queue, the key alone, or the key and the payload
+// in a std::pair<>, and a reference to one in a queue.
+template <typename T, typename V>
+struct element
+{
+  using type = std::pair<T, V>;
+  using reference = std::pair<T const &, V const &>;
+  static T const &key(type const &e) noexcept { return e.first; }
+};
+
+template <typename T>
+struct element<T, void>
+{
+  using type = T;
+  using reference = T const &;
+  static T const &key(type const &e) noexcept { return e; }
+};
+
+} // namespace prio_q_internal
+
+template <std::size_t block_size, typename T, typename V,
+                                  typename Compare = std::less<T>,
+                                  typename Allocator = std::allocator<T>,
+                                  std::size_t arity = 2,
+                                  typename Storage = contiguous_storage>
+class prio_queue
+  : private Compare
+  , private prio_q_internal::layout<block_size, T, V, Allocator, Storage>::payloads
+{
+  using address = prio_q_internal::heap_heap_addressing<block_size, arity>;
+  using layout = prio_q_internal::layout<block_size, T, V, Allocator, Storage>;
+  using P = typename layout::payloads;
+  using simd = prio_q_internal::simd_best_of<T, arity,
+                                             prio_q_internal::key_order<T, Compare>::value>;
+public:
+  prio_queue(Compare const &compare = Compare()) : Compare(compare) { }
+  // The payloads are allocated from a copy of a, rebound to V.
+  explicit prio_queue(Allocator const &a)
+      : prio_queue(Compare(), a) { }
+  explicit prio_queue(Compare const &compare, Allocator const &a)
+      : Compare(compare)
+      , P(typename P::allocator_type(a))
+      , m_storage(a) { }
+  template <typename InputIterator>
+  prio_queue(InputIterator first, InputIterator last,
+             Compare const &compare = Compare());
+  template <typename InputIterator>
+  prio_queue(InputIterator first, InputIterator last,
+             Compare const &compare, Allocator const &a);
+
+  using value_type = T;
+  using payload_type = V;
+  using allocator_type = Allocator;
+
+  template <typename U, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  push(U &&u);
+
+  template <typename U, typename X>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  push(U &&key, X &&value);
+
+  // Constructs the payload from args in its place.
+  template <typename U, typename ... Args, typename X = V>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  emplace(U &&key, Args&& ... args);
+
+  // If copying an element or allocating throws, the elements pushed before
+  // it stay in the queue, which is still a heap.
+  template <typename InputIterator>
+  void push_range(InputIterator first, InputIterator last);
+
+  template <typename InputIterator>
+  void assign(InputIterator first, InputIterator last);
+
+  // Moves all elements of other to this queue, and leaves other empty. As
+  // with push_range(), the heap is rebuilt if other is at least as large, and
+  // the elements from other are sifted up one at a time otherwise. If moving
+  // an element throws, those already moved stay in this queue, the rest stay
+  // in other, and both are heaps.
+  void merge(prio_queue &&other);
+
+  // Moves the elements that do not sort before threshold to the returned
+  // queue, which has the comparator and allocator of this one. Both heaps are
+  // rebuilt, in linear time.
+  prio_queue split(T const &threshold);
+
+  // Moves size() / 2 elements to the returned queue, the last ones in slot
+  // order. Every parent has a lower slot than its children, so what is left
+  // is still a heap, with the same top, and only the returned queue is
+  // rebuilt.
+  prio_queue split_half();
+
+  // A copy that also has the capacity of this queue. Copies have every
+  // element in the same slot as the original, so they walk the same blocks
+  // in the same order, and a clone also grows exactly as the original would.
+  prio_queue clone() const;
+
+  // Writes the keys and payloads to os, in their heap order, as a binary
+  // snapshot that load() reads back without sifting anything. Both must be
+  // trivially copyable, and the snapshot can only be read on machines with
+  // the same byte order and type sizes.
+  void save(std::ostream &os) const;
+
+  // Replaces the elements with those of a snapshot from save(), of a queue
+  // with the same key and payload types and the same comparator. A snapshot
+  // from a queue with another block size or arity has the elements in
+  // another heap order, and the heap is rebuilt, in linear time. Throws
+  // std::runtime_error, and leaves the queue empty, if the snapshot is
+  // malformed, truncated, or fails its checksum.
+  void load(std::istream &is);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, value_type const &>
+  top() const noexcept;
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+  top() noexcept;
+
+  void pop() noexcept(std::is_nothrow_destructible<T>::value);
+
+  // The top moved out and popped, as the key, or as std::pair<T, V> when
+  // there is a payload.
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, T>
+  pop_value();
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, std::pair<T, U>>
+  pop_value();
+
+  // Moves the best k elements, or all of them if there are fewer, to out in
+  // order, as keys, or as std::pair<T, V> when there is a payload.
+  template <typename OutputIterator>
+  OutputIterator pop_n(std::size_t k, OutputIterator out);
+
+  // Moves all elements to out in order, and leaves the queue empty.
+  template <typename OutputIterator>
+  OutputIterator drain(OutputIterator out);
+
+  // Walks the elements in order without changing the queue. The next
+  // element is the best in a small heap of the indexes of the children of
+  // the elements already visited, so the first k cost O(k log k), and only
+  // the blocks they are in are touched. The elements are keys, or
+  // std::pair<T const &, V const &> when there is a payload. Changing the
+  // queue invalidates the iterators.
+  class ordered_iterator;
+
+  class ordered_view
+  {
+  public:
+    ordered_iterator begin() const { return ordered_iterator(m_q, 0); }
+    ordered_iterator end() const noexcept { return ordered_iterator(); }
+  private:
+    friend class prio_queue;
+    explicit ordered_view(prio_queue const *q) noexcept : m_q(q) { }
+    prio_queue const *m_q;
+  };
+
+  ordered_view ordered() const noexcept { return ordered_view(this); }
+
+  // Copies the best k elements, or all of them if there are fewer, to out
+  // in order, as the elements of ordered(), without changing the queue.
+  template <typename OutputIterator>
+  OutputIterator peek_top_k(std::size_t k, OutputIterator out) const;
+
+  // Walks the elements in slot order, which is no particular priority
+  // order, as the elements of ordered(). Changing the queue invalidates the
+  // iterators.
+  class const_iterator;
+  using iterator = const_iterator;
+
+  const_iterator begin() const noexcept;
+  const_iterator end() const noexcept;
+
+  // Removes the elements, as given by the iterators, that pred is true for,
+  // by compacting the rest towards the front, and rebuilding the heap once
+  // if any was removed. Returns the number of elements removed.
+  template <typename Pred>
+  std::size_t erase_if(Pred pred);
+
+  // Replaces every key k with fn(k), and rebuilds the heap once. If fn
+  // throws, the keys already replaced stay so, and the heap is rebuilt.
+  template <typename Fn>
+  void transform_keys(Fn fn);
+
+  template <typename U=V>
+  std::enable_if_t<!std::is_same<U, void>::value>
+  reschedule_top(T t);
+
+  template <typename U=V>
+  std::enable_if_t<std::is_same<U, void>::value>
+  reschedule_top(T t);
+
+  // Replaces both the key and the payload of the top, with one sift down.
+  template <typename U, typename X, typename Y = V>
+  std::enable_if_t<!std::is_same<Y, void>::value>
+  replace_top(U &&key, X &&value);
+
+  bool empty() const noexcept;
+
+  std::size_t size() const noexcept;
+
+  void reserve(std::size_t n);
+
+  std::size_t capacity() const noexcept;
+
+  void shrink_to_fit();
+
+  void clear() noexcept(std::is_nothrow_destructible<T>::value);
+private:
+  template <typename U>
+  void push_key(U &&key);
+
+  void sift_up(std::size_t hole_idx);
+
+  template <typename Iterator>
+  void reserve_for(Iterator first, Iterator last, std::forward_iterator_tag);
+
+  template <typename Iterator>
+  void reserve_for(Iterator, Iterator, std::input_iterator_tag) { }
+
+  template <typename E, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  append(E &&e);
+
+  template <typename E, typename X = V>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  append(E &&e);
+
+  void heapify();
+
+  // Sifts up the elements from old_end, or rebuilds the heap if they are at
+  // least as many as the old_size ones before them.
+  void restore_heap(std::size_t old_end, std::size_t old_size);
+
+  // Moves element idx of q to the end of this queue, without sifting it up.
+  void append_from(prio_queue &q, std::size_t idx);
+
+  // An empty queue with the comparator and allocator of this one.
+  prio_queue empty_like();
+
+  // Removes the elements that remove(idx) is true for, after which their
+  // slots are only destroyed, by compacting the rest towards the front in
+  // place. The heap is not restored. Returns the number of elements removed.
+  // If remove() throws, the element it threw for and the ones after it are
+  // kept, and the heap is rebuilt before the exception propagates.
+  template <typename F>
+  std::size_t remove_slots(F remove);
+
+  template <typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value, typename prio_q_internal::element<T, V>::reference>
+  element_at(std::size_t idx) const noexcept { return m_storage[idx]; }
+
+  template <typename X = V>
+  std::enable_if_t<!std::is_same<X, void>::value, typename prio_q_internal::element<T, V>::reference>
+  element_at(std::size_t idx) const noexcept
+  {
+    return { m_storage[idx], payloads().get(idx) };
+  }
+
+  prio_queue(prio_queue const &q, std::size_t storage_size);
+
+  // Calls f with the runs of bytes of a snapshot, after the header.
+  template <typename F>
+  void for_each_snapshot_run(F f) const;
+
+  template <typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  save_payload(unsigned char *, std::size_t) const noexcept { }
+
+  template <typename X = V>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  save_payload(unsigned char *p, std::size_t idx) const noexcept;
+
+  template <typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  load_element(unsigned char const *key, unsigned char const *);
+
+  template <typename X = V>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  load_element(unsigned char const *key, unsigned char const *value);
+
+  template <typename OutputIterator, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value, OutputIterator>
+  move_out(std::size_t idx, OutputIterator out);
+
+  template <typename OutputIterator, typename X = V>
+  std::enable_if_t<!std::is_same<X, void>::value, OutputIterator>
+  move_out(std::size_t idx, OutputIterator out);
+
+  std::size_t best_child(std::size_t idx, std::size_t last_idx) const noexcept;
+
+  void prefetch_child_blocks(std::size_t idx, std::size_t last_idx) const noexcept;
+
+  bool sorts_before(value_type const &lv, value_type const &rv) const noexcept;
+
+  // The payload store, which an interleaved layout keeps in the key vector.
+  P &payloads(std::false_type) noexcept { return *this; }
+  P const &payloads(std::false_type) const noexcept { return *this; }
+  auto payloads(std::true_type) noexcept { return m_storage.values(); }
+  auto payloads(std::true_type) const noexcept { return m_storage.values(); }
+  decltype(auto) payloads() noexcept
+  {
+    return payloads(std::integral_constant<bool, layout::interleaved>{});
+  }
+  decltype(auto) payloads() const noexcept
+  {
+    return payloads(std::integral_constant<bool, layout::interleaved>{});
+  }
+
+  typename layout::keys m_storage;
+  size_t sift_down(std::size_t idx, T t) noexcept(noexcept(std::declval<T&>() = std::declval<T&&>()));
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+class prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::ordered_iterator
+{
+  using element = prio_q_internal::element<T, V>;
+public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = typename element::type;
+  using reference = typename element::reference;
+  using pointer = void;
+  using difference_type = std::ptrdiff_t;
+
+  ordered_iterator() = default;
+
+  reference operator*() const noexcept;
+  ordered_iterator &operator++();
+  ordered_iterator operator++(int)
+  {
+    auto i = *this;
+    ++*this;
+    return i;
+  }
+
+  friend bool operator==(ordered_iterator const &l, ordered_iterator const &r) noexcept
+  {
+    return l.current() == r.current();
+  }
+  friend bool operator!=(ordered_iterator const &l, ordered_iterator const &r) noexcept
+  {
+    return !(l == r);
+  }
+private:
+  friend class prio_queue;
+  friend class ordered_view;
+
+  // Room for the frontier of the first expected elements.
+  ordered_iterator(prio_queue const *q, std::size_t expected);
+
+  std::size_t current() const noexcept
+  {
+    return m_frontier.empty() ? 0 : m_frontier.front();
+  }
+
+  prio_queue const         *m_q = nullptr;
+  // A heap of indexes, with the best element first.
+  std::vector<std::size_t>  m_frontier;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+class prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::const_iterator
+{
+  using element = prio_q_internal::element<T, V>;
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = typename element::type;
+  using reference = typename element::reference;
+  using pointer = void;
+  using difference_type = std::ptrdiff_t;
+
+  const_iterator() = default;
+
+  reference operator*() const noexcept { return m_q->element_at(m_idx); }
+  const_iterator &operator++() noexcept
+  {
+    ++m_idx;
+    m_idx += address::block_offset(m_idx) == 0;
+    return *this;
+  }
+  const_iterator operator++(int) noexcept
+  {
+    auto i = *this;
+    ++*this;
+    return i;
+  }
+
+  friend bool operator==(const_iterator const &l, const_iterator const &r) noexcept
+  {
+    return l.m_idx == r.m_idx;
+  }
+  friend bool operator!=(const_iterator const &l, const_iterator const &r) noexcept
+  {
+    return !(l == r);
+  }
+private:
+  friend class prio_queue;
+
+  const_iterator(prio_queue const *q, std::size_t idx) noexcept
+    : m_q(q), m_idx(idx) { }
+
+  prio_queue const *m_q = nullptr;
+  std::size_t       m_idx = 1;
+};
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename InputIterator>
+inline
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+prio_queue(InputIterator first, InputIterator last, Compare const &compare)
+  : Compare(compare)
+{
+  assign(first, last);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename InputIterator>
+inline
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+prio_queue(InputIterator first, InputIterator last, Compare const &compare,
+           Allocator const &a)
+  : Compare(compare)
+  , P(typename P::allocator_type(a))
+  , m_storage(a)
+{
+  assign(first, last);
+}
+
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+push(U &&u)
+{
+  push_key(std::forward<U>(u));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename U, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+push(U &&key, X &&value)
+{
+  payloads().push_back(std::forward<X>(value));
+  push_key(std::forward<U>(key));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename U, typename ... Args, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+emplace(U &&key, Args&& ... args)
+{
+  payloads().emplace_back(std::forward<Args>(args)...);
+  push_key(std::forward<U>(key));
+}
+
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename InputIterator>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+push_range(InputIterator first, InputIterator last)
+{
+  reserve_for(first, last,
+              typename std::iterator_traits<InputIterator>::iterator_category{});
+  auto const old_end  = m_storage.size();
+  auto const old_size = size();
+  try
+  {
+    for (; first != last; ++first)
+    {
+      append(*first);
+    }
+  }
+  catch (...)
+  {
+    restore_heap(old_end, old_size);
+    throw;
+  }
+  restore_heap(old_end, old_size);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename InputIterator>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+assign(InputIterator first, InputIterator last)
+{
+  clear();
+  reserve_for(first, last,
+              typename std::iterator_traits<InputIterator>::iterator_category{});
+  try
+  {
+    for (; first != last; ++first)
+    {
+      append(*first);
+    }
+  }
+  catch (...)
+  {
+    heapify();
+    throw;
+  }
+  heapify();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+merge(prio_queue &&other)
+{
+  assert(&other != this);
+  auto const wanted = size() + other.size();
+  if (wanted > capacity())
+  {
+    reserve(std::max(wanted, capacity() * 2));
+  }
+  auto const old_end  = m_storage.size();
+  auto const old_size = size();
+  auto const end = other.m_storage.size();
+  std::size_t idx = 1;
+  try
+  {
+    for (; idx < end; ++idx)
+    {
+      if (rollbear_prio_q_likely(address::block_offset(idx) != 0))
+      {
+        append_from(other, idx);
+      }
+    }
+  }
+  catch (...)
+  {
+    restore_heap(old_end, old_size);
+    other.remove_slots([idx](std::size_t i) { return i < idx; });
+    other.heapify();
+    throw;
+  }
+  other.clear();
+  restore_heap(old_end, old_size);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+split(T const &threshold)
+{
+  auto rest = empty_like();
+  try
+  {
+    remove_slots([&](std::size_t idx) {
+      if (sorts_before(m_storage[idx], threshold)) return false;
+      rest.append_from(*this, idx);
+      return true;
+    });
+  }
+  catch (...)
+  {
+    // The elements already moved go back, to slots this queue still has the
+    // memory for.
+    merge(std::move(rest));
+    throw;
+  }
+  heapify();
+  rest.heapify();
+  return rest;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+split_half()
+{
+  auto half = empty_like();
+  auto const n = size() / 2;
+  half.reserve(n);
+  try
+  {
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      half.append_from(*this, m_storage.size() - 1);
+      m_storage.pop_back();
+      payloads().pop_back();
+    }
+  }
+  catch (...)
+  {
+    // The slots they came from are still allocated.
+    merge(std::move(half));
+    throw;
+  }
+  half.heapify();
+  return half;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename F>
+std::size_t
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+remove_slots(F remove)
+{
+  std::size_t kept = 0;
+  std::size_t to = 1;
+  auto const old_size = size();
+  auto const end = m_storage.size();
+  auto const keep = [&](std::size_t idx) {
+    if (to != idx)
+    {
+      m_storage[to] = std::move(m_storage[idx]);
+      payloads().move(idx, to);
+    }
+    ++kept;
+    ++to;
+    to += address::block_offset(to) == 0;
+  };
+  auto const truncate = [&] {
+    while (size() != kept)
+    {
+      m_storage.pop_back();
+      payloads().pop_back();
+    }
+  };
+  std::size_t idx = 1;
+  try
+  {
+    for (; idx < end; ++idx)
+    {
+      if (rollbear_prio_q_unlikely(address::block_offset(idx) == 0)) continue;
+      if (remove(idx)) continue;
+      keep(idx);
+    }
+  }
+  catch (...)
+  {
+    for (; idx < end; ++idx)
+    {
+      if (rollbear_prio_q_unlikely(address::block_offset(idx) == 0)) continue;
+      keep(idx);
+    }
+    truncate();
+    heapify();
+    throw;
+  }
+  truncate();
+  return old_size - kept;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+typename prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::const_iterator
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+begin()
+const
+noexcept
+{
+  return const_iterator(this, 1);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+typename prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::const_iterator
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+end()
+const
+noexcept
+{
+  // The slot after the last may be the gap at the start of a block, which
+  // the iterator steps over.
+  auto const end = m_storage.size();
+  return const_iterator(this, end + (address::block_offset(end) == 0));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename Pred>
+std::size_t
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+erase_if(Pred pred)
+{
+  auto const removed = remove_slots([&](std::size_t idx) {
+    return static_cast<bool>(pred(element_at(idx)));
+  });
+  if (removed) heapify();
+  return removed;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename Fn>
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+transform_keys(Fn fn)
+{
+  auto const end = m_storage.size();
+  try
+  {
+    for (std::size_t idx = 1; idx < end; ++idx)
+    {
+      if (rollbear_prio_q_unlikely(address::block_offset(idx) == 0)) continue;
+      auto &key = m_storage[idx];
+      key = fn(static_cast<T const &>(key));
+    }
+  }
+  catch (...)
+  {
+    heapify();
+    throw;
+  }
+  heapify();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename Iterator>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+reserve_for(Iterator first, Iterator last, std::forward_iterator_tag)
+{
+  // Grow geometrically, so that repeated small ranges don't reallocate
+  // every time.
+  auto const wanted = size() + static_cast<std::size_t>(std::distance(first, last));
+  if (wanted > capacity())
+  {
+    reserve(std::max(wanted, capacity() * 2));
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename E, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+append(E &&e)
+{
+  m_storage.push_back(std::forward<E>(e));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename E, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+append(E &&e)
+{
+  payloads().push_back(std::get<1>(std::forward<E>(e)));
+  try
+  {
+    m_storage.push_back(std::get<0>(std::forward<E>(e)));
+  }
+  catch (...)
+  {
+    payloads().pop_back();
+    throw;
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+heapify()
+{
+  // Floyd's bottom up construction. Children always have higher indexes
+  // than their parents, so visiting the nodes from the last one and down to
+  // the root sifts each miniheap after all of the miniheaps below it are
+  // already in order.
+  if (m_storage.size() < 3) return;
+  auto const last_idx = m_storage.size() - 1;
+  for (auto idx = last_idx; idx != 0; --idx)
+  {
+    if (rollbear_prio_q_unlikely(address::block_offset(idx) == 0)) continue;
+    auto next = best_child(idx, last_idx);
+    if (next == 0 || !sorts_before(m_storage[next], m_storage[idx])) continue;
+    auto tmp  = std::move(m_storage[idx]);
+    auto val  = std::move(payloads().get(idx));
+    auto hole = idx;
+    do
+    {
+      m_storage[hole] = std::move(m_storage[next]);
+      payloads().move(next, hole);
+      hole = next;
+      next = best_child(hole, last_idx);
+    } while (next != 0 && sorts_before(m_storage[next], tmp));
+    m_storage[hole] = std::move(tmp);
+    payloads().store(hole, std::move(val));
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+restore_heap(std::size_t old_end, std::size_t old_size)
+{
+  if (size() - old_size >= old_size)
+  {
+    heapify();
+    return;
+  }
+  for (auto idx = old_end; idx != m_storage.size(); ++idx)
+  {
+    if (rollbear_prio_q_likely(address::block_offset(idx) != 0))
+    {
+      sift_up(idx);
+    }
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+append_from(prio_queue &q, std::size_t idx)
+{
+  payloads().push_back(std::move(q.payloads().get(idx)));
+  try
+  {
+    m_storage.push_back(std::move(q.m_storage[idx]));
+  }
+  catch (...)
+  {
+    q.payloads().store(idx, std::move(payloads().back()));
+    payloads().pop_back();
+    throw;
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+prio_queue(prio_queue const &q, std::size_t storage_size)
+  : Compare(q)
+  , P(static_cast<P const&>(q), storage_size)
+  , m_storage(q.m_storage, storage_size)
+{
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+clone()
+const
+{
+  return prio_queue(*this, m_storage.capacity());
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+save(std::ostream &os)
+const
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "save() requires trivially copyable keys");
+  static_assert(prio_q_internal::snapshot_copyable<V>::value,
+                "save() requires trivially copyable payloads");
+  prio_q_internal::snapshot_header const header{
+    prio_q_internal::snapshot_magic,
+    prio_q_internal::snapshot_version,
+    block_size,
+    arity,
+    sizeof(T),
+    prio_q_internal::payload_size<V>::value,
+    size()
+  };
+  prio_q_internal::snapshot_checksum sum;
+  auto write = [&](unsigned char const *p, std::size_t n) {
+    sum.add(p, n);
+    os.write(reinterpret_cast<char const*>(p), static_cast<std::streamsize>(n));
+  };
+  write(reinterpret_cast<unsigned char const*>(&header), sizeof(header));
+  for_each_snapshot_run(write);
+  std::uint64_t const checksum = sum.value();
+  os.write(reinterpret_cast<char const*>(&checksum), sizeof(checksum));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+load(std::istream &is)
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "load() requires trivially copyable keys");
+  static_assert(prio_q_internal::snapshot_copyable<V>::value,
+                "load() requires trivially copyable payloads");
+  constexpr auto value_size = prio_q_internal::payload_size<V>::value;
+  constexpr auto chunk = prio_q_internal::snapshot_chunk;
+  clear();
+  prio_q_internal::snapshot_header header;
+  if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)))
+  {
+    throw std::runtime_error("prio_queue snapshot is truncated");
+  }
+  if (header.magic != prio_q_internal::snapshot_magic
+      || header.version != prio_q_internal::snapshot_version)
+  {
+    throw std::runtime_error("not a prio_queue snapshot");
+  }
+  if (header.key_size != sizeof(T) || header.payload_size != value_size)
+  {
+    throw std::runtime_error("prio_queue snapshot has other key or payload sizes");
+  }
+  try
+  {
+    std::vector<unsigned char> buffer(chunk * (sizeof(T) + value_size));
+    auto const keys = buffer.data();
+    auto const values = keys + chunk * sizeof(T);
+    prio_q_internal::snapshot_checksum sum;
+    sum.add(reinterpret_cast<unsigned char const*>(&header), sizeof(header));
+    for (auto left = header.count; left != 0;)
+    {
+      auto const n = static_cast<std::size_t>(std::min<std::uint64_t>(left, chunk));
+      // The count is not yet known to be right, so the memory grows with
+      // what is actually read.
+      auto const wanted = size() + n;
+      if (wanted > capacity())
+      {
+        reserve(std::max(wanted, capacity() * 2));
+      }
+      if (!is.read(reinterpret_cast<char*>(keys), static_cast<std::streamsize>(n * sizeof(T)))
+          || !is.read(reinterpret_cast<char*>(values), static_cast<std::streamsize>(n * value_size)))
+      {
+        throw std::runtime_error("prio_queue snapshot is truncated");
+      }
+      sum.add(keys, n * sizeof(T));
+      sum.add(values, n * value_size);
+      for (std::size_t i = 0; i != n; ++i)
+      {
+        load_element(keys + i * sizeof(T), values + i * value_size);
+      }
+      left -= n;
+    }
+    std::uint64_t checksum;
+    if (!is.read(reinterpret_cast<char*>(&checksum), sizeof(checksum)))
+    {
+      throw std::runtime_error("prio_queue snapshot is truncated");
+    }
+    if (sum.value() != checksum)
+    {
+      throw std::runtime_error("prio_queue snapshot fails its checksum");
+    }
+    if (header.block_size != block_size || header.arity != arity)
+    {
+      heapify();
+    }
+  }
+  catch (...)
+  {
+    clear();
+    throw;
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename F>
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+for_each_snapshot_run(F f)
+const
+{
+  constexpr auto value_size = prio_q_internal::payload_size<V>::value;
+  constexpr auto chunk = prio_q_internal::snapshot_chunk;
+  std::vector<unsigned char> buffer(chunk * (sizeof(T) + value_size));
+  auto const keys = buffer.data();
+  auto const values = keys + chunk * sizeof(T);
+  auto const end = m_storage.size();
+  std::size_t idx = 1;
+  while (idx < end)
+  {
+    std::size_t n = 0;
+    for (; idx < end && n != chunk; ++idx)
+    {
+      if (rollbear_prio_q_unlikely(address::block_offset(idx) == 0)) continue;
+      std::memcpy(keys + n * sizeof(T), &m_storage[idx], sizeof(T));
+      save_payload(values + n * value_size, idx);
+      ++n;
+    }
+    f(keys, n * sizeof(T));
+    f(values, n * value_size);
+  }
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename X>
 inline
 std::enable_if_t<!std::is_same<X, void>::value>
-prio_queue<block_size, T, V, Compare, Allocator>::
-push(U &&key, X &&value)
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+save_payload(unsigned char *p, std::size_t idx)
+const
+noexcept
 {
-  P::push_back(std::forward<X>(value));
-  push_key(std::forward<U>(key));
+  std::memcpy(p, &payloads().get(idx), sizeof(V));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+load_element(unsigned char const *key, unsigned char const *)
+{
+  m_storage.push_back(prio_q_internal::snapshot_value<T>(key));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+load_element(unsigned char const *key, unsigned char const *value)
+{
+  payloads().push_back(prio_q_internal::snapshot_value<V>(value));
+  m_storage.push_back(prio_q_internal::snapshot_value<T>(key));
 }
 
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+empty_like()
+{
+  return prio_queue(static_cast<Compare const&>(*this),
+                    prio_q_internal::storage_allocator<Allocator>(m_storage, 0));
+}
 
 template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
+                                  typename Allocator, std::size_t arity, typename Storage>
 template <typename U>
 inline
 void
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 push_key(U &&key)
 {
-  auto hole_idx = m_storage.push_back(std::forward<U>(key));
-  auto tmp      = std::move(m_storage.back());
-  auto val      = std::move(P::back());
+  sift_up(m_storage.push_back(std::forward<U>(key)));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+sift_up(std::size_t hole_idx)
+{
+  auto tmp = std::move(m_storage[hole_idx]);
+  auto val = std::move(payloads().get(hole_idx));
 
   while (rollbear_prio_q_likely(hole_idx != 1U))
   {
@@ -478,18 +3289,18 @@ push_key(U &&key)
     auto &p     = m_storage[parent];
     if (rollbear_prio_q_likely(!sorts_before(tmp, p))) break;
     m_storage[hole_idx] = std::move(p);
-    P::move(parent, hole_idx);
+    payloads().move(parent, hole_idx);
     hole_idx = parent;
   }
   m_storage[hole_idx] = std::move(tmp);
-  P::store(hole_idx, std::move(val));
+  payloads().store(hole_idx, std::move(val));
 }
 
 template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
+                                  typename Allocator, std::size_t arity, typename Storage>
 inline
 void
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 pop()
 noexcept(std::is_nothrow_destructible<T>::value)
 {
@@ -498,44 +3309,209 @@ noexcept(std::is_nothrow_destructible<T>::value)
   auto const  last_idx = m_storage.size() - 1;
   for (; ;)
   {
-    auto lc = address::child_of(idx);
-    if (rollbear_prio_q_unlikely(lc > last_idx)) break;
-    auto const sibling_offset = rollbear_prio_q_unlikely(address::is_block_leaf(idx))
-                                ? address::block_size : 1;
-    auto       rc             = lc + sibling_offset;
-    auto       i              =
-                   rc < last_idx && !sorts_before(m_storage[lc], m_storage[rc]);
-    auto       next           = i ? rc : lc;
+    prefetch_child_blocks(idx, last_idx);
+    auto next = best_child(idx, last_idx);
+    if (rollbear_prio_q_unlikely(next == 0)) break;
     m_storage[idx] = std::move(m_storage[next]);
-    P::move(next, idx);
+    payloads().move(next, idx);
     idx = next;
   }
   if (rollbear_prio_q_likely(idx != last_idx))
   {
     auto last     = std::move(m_storage.back());
-    auto last_val = std::move(P::back());
+    auto last_val = std::move(payloads().back());
     while (rollbear_prio_q_likely(idx != 1))
     {
       auto parent = address::parent_of(idx);
       if (rollbear_prio_q_likely(!sorts_before(last, m_storage[parent]))) break;
       m_storage[idx] = std::move(m_storage[parent]);
-      P::move(parent, idx);
+      payloads().move(parent, idx);
       idx = parent;
     }
     m_storage[idx] = std::move(last);
-    P::store(idx, std::move(last_val));
+    payloads().store(idx, std::move(last_val));
   }
   m_storage.pop_back();
-  P::pop_back();
+  payloads().pop_back();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value, T>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+pop_value()
+{
+  assert(!empty());
+  T key(std::move(m_storage[1]));
+  pop();
+  return key;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, std::pair<T, U>>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+pop_value()
+{
+  assert(!empty());
+  std::pair<T, U> top(std::move(m_storage[1]), std::move(payloads().top()));
+  pop();
+  return top;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename OutputIterator>
+OutputIterator
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+pop_n(std::size_t k, OutputIterator out)
+{
+  if (k >= size()) return drain(out);
+  // Each pop() only sifts the hole left at the root down to a leaf, which
+  // measures cheaper than both finding the best k among the nodes near the
+  // root and restoring the heap below them, and than selecting them among
+  // all elements and building a new heap of the rest.
+  while (k--)
+  {
+    out = move_out(1, out);
+    pop();
+  }
+  return out;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename OutputIterator>
+OutputIterator
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+drain(OutputIterator out)
+{
+  // Sorting is cheaper than popping one at a time, since it doesn't jump
+  // between the blocks.
+  using element = prio_q_internal::element<T, V>;
+  std::vector<typename element::type> elements;
+  elements.reserve(size());
+  auto const end = m_storage.size();
+  for (std::size_t idx = 1; idx < end; ++idx)
+  {
+    if (rollbear_prio_q_likely(address::block_offset(idx) != 0))
+    {
+      move_out(idx, std::back_inserter(elements));
+    }
+  }
+  clear();
+  std::sort(elements.begin(), elements.end(),
+            [this](auto const &lh, auto const &rh) {
+              return sorts_before(element::key(lh), element::key(rh));
+            });
+  return std::move(elements.begin(), elements.end(), out);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename OutputIterator>
+OutputIterator
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+peek_top_k(std::size_t k, OutputIterator out)
+const
+{
+  k = std::min(k, size());
+  for (ordered_iterator i(this, k); k != 0; --k)
+  {
+    *out = *i;
+    ++out;
+    // The children of the last one are not needed.
+    if (k != 1) ++i;
+  }
+  return out;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+ordered_iterator::
+ordered_iterator(prio_queue const *q, std::size_t expected)
+  : m_q(q)
+{
+  // Every element visited replaces itself with at most arity children.
+  m_frontier.reserve(expected * (arity - 1) + 1);
+  if (!q->empty()) m_frontier.push_back(1);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+typename prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::ordered_iterator::reference
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+ordered_iterator::
+operator*()
+const
+noexcept
+{
+  assert(!m_frontier.empty());
+  return m_q->element_at(m_frontier.front());
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+typename prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::ordered_iterator &
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+ordered_iterator::
+operator++()
+{
+  assert(!m_frontier.empty());
+  auto const idx = m_frontier.front();
+  auto const worse = [q = m_q](std::size_t l, std::size_t r) {
+    return q->sorts_before(q->m_storage[r], q->m_storage[l]);
+  };
+  std::pop_heap(m_frontier.begin(), m_frontier.end(), worse);
+  m_frontier.pop_back();
+  auto const last_idx = m_q->m_storage.size() - 1;
+  auto child = address::child_of(idx);
+  for (std::size_t i = 0; i != arity && child <= last_idx; ++i)
+  {
+    m_frontier.push_back(child);
+    std::push_heap(m_frontier.begin(), m_frontier.end(), worse);
+    child = address::next_sibling(child);
+  }
+  return *this;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename OutputIterator, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value, OutputIterator>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+move_out(std::size_t idx, OutputIterator out)
+{
+  *out = std::move(m_storage[idx]);
+  return ++out;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename OutputIterator, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value, OutputIterator>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+move_out(std::size_t idx, OutputIterator out)
+{
+  *out = std::pair<T, V>(std::move(m_storage[idx]), std::move(payloads().get(idx)));
+  return ++out;
 }
 
 
 template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
+                                  typename Allocator, std::size_t arity, typename Storage>
 template <typename U>
 inline
 std::enable_if_t<std::is_same<U, void>::value, T const &>
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 top()
 const
 noexcept
@@ -545,61 +3521,75 @@ noexcept
 }
 
 template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
+                                  typename Allocator, std::size_t arity, typename Storage>
 template <typename U>
 inline
 std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 top()
 noexcept
 {
   assert(!empty());
-  return { m_storage[1], P::top() };
+  return { m_storage[1], payloads().top() };
 }
 
-template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
 template <typename U>
 inline
 std::enable_if_t<!std::is_same<U, void>::value>
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 reschedule_top(T t)
 {
   assert(!empty());
-  auto val   = std::move(P::top());
-  size_t idx = do_reschedule_top(t);
-  P::store(idx, std::move(val));
+  auto val   = std::move(payloads().top());
+  size_t idx = sift_down(1, std::move(t));
+  payloads().store(idx, std::move(val));
 }
 
-template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
 template <typename U>
 inline
 std::enable_if_t<std::is_same<U, void>::value>
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 reschedule_top(T t)
 {
   assert(!empty());
-  do_reschedule_top(t);
+  sift_down(1, std::move(t));
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+template <typename U, typename X, typename Y>
+inline
+std::enable_if_t<!std::is_same<Y, void>::value>
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+replace_top(U &&key, X &&value)
+{
+  assert(!empty());
+  // Both may refer to the top, that the sift down overwrites.
+  V val(std::forward<X>(value));
+  size_t idx = sift_down(1, T(std::forward<U>(key)));
+  payloads().store(idx, std::move(val));
 }
 
-template <std::size_t block_size, typename T, typename V, typename Compare, typename Allocator>
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
 size_t
-prio_queue<block_size, T, V, Compare, Allocator>::
-do_reschedule_top(T t)
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+sift_down(std::size_t idx, T t)
 noexcept(noexcept(std::declval<T&>() = std::declval<T&&>()))
 {
-  std::size_t idx      = 1;
   auto const  last_idx = m_storage.size() - 1;
   for (;;)
   {
-    auto lc = address::child_of(idx);
-    if (rollbear_prio_q_unlikely(lc > last_idx)) break;
-    auto const sibling_offset = rollbear_prio_q_unlikely(address::is_block_leaf(idx)) ? address::block_size : 1;
-    auto rc = lc + sibling_offset;
-    auto i = rc <= last_idx && !sorts_before(m_storage[lc], m_storage[rc]);
-    auto next = i ? rc : lc;
+    prefetch_child_blocks(idx, last_idx);
+    auto next = best_child(idx, last_idx);
+    if (rollbear_prio_q_unlikely(next == 0)) break;
     if (sorts_before(t, m_storage[next])) break;
     m_storage[idx] = std::move(m_storage[next]);
-    P::move(next, idx);
+    payloads().move(next, idx);
     idx = next;
   }
   m_storage[idx] = std::move(t);
@@ -607,10 +3597,74 @@ noexcept(noexcept(std::declval<T&>() = std::declval<T&&>()))
 }
 
 template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+std::size_t
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+best_child(std::size_t idx, std::size_t last_idx)
+const
+noexcept
+{
+  auto child = address::child_of(idx);
+  if (rollbear_prio_q_unlikely(child > last_idx)) return 0;
+  if (simd::enabled && layout::contiguous_blocks
+      && rollbear_prio_q_likely(address::children_in_block(idx))
+      && rollbear_prio_q_likely(child + arity - 1 <= last_idx))
+  {
+    return child + simd::index(&m_storage[child]);
+  }
+  // In a binary tree, the children are never split between the block and
+  // its child blocks, so the sibling is always at the same distance.
+  auto const sibling_offset = rollbear_prio_q_unlikely(address::is_block_leaf(idx))
+                              ? address::block_size : 1;
+  auto best = child;
+  for (std::size_t i = 1; i != arity; ++i)
+  {
+    child = arity == 2 ? child + sibling_offset : address::next_sibling(child);
+    if (rollbear_prio_q_unlikely(child > last_idx)) break;
+    best = sorts_before(m_storage[child], m_storage[best]) ? child : best;
+  }
+  return best;
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+prefetch_child_blocks(std::size_t idx, std::size_t last_idx)
+const
+noexcept
+{
+#ifdef rollbear_prio_q_prefetch
+  // The leaves below idx are adjacent, and so are the blocks below them.
+  auto leaf = idx;
+  std::size_t num_blocks = arity;
+  for (int i = 0; i != ROLLBEAR_PRIO_QUEUE_PREFETCH_DISTANCE; ++i)
+  {
+    if (address::is_block_leaf(leaf)) return;
+    leaf = address::child_of(leaf);
+    num_blocks *= arity;
+  }
+  if (!address::is_block_leaf(leaf)) return;
+  auto block = address::child_of(leaf);
+  for (; num_blocks != 0 && block <= last_idx; --num_blocks)
+  {
+    m_storage.prefetch(block);
+    payloads().prefetch(block);
+    block += address::block_size;
+  }
+#else
+  static_cast<void>(idx);
+  static_cast<void>(last_idx);
+#endif
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
 inline
 bool
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 empty()
 const
 noexcept
@@ -619,10 +3673,10 @@ noexcept
 }
 
 template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
+                                  typename Allocator, std::size_t arity, typename Storage>
 inline
 std::size_t
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 size()
 const
 noexcept
@@ -632,10 +3686,59 @@ noexcept
 }
 
 template <std::size_t block_size, typename T, typename V, typename Compare,
-                                  typename Allocator>
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+reserve(std::size_t n)
+{
+  // every block holds block_size - 1 elements
+  auto const storage_size = (n + address::block_size - 2)
+                          / (address::block_size - 1) * address::block_size;
+  payloads().reserve(storage_size);
+  m_storage.reserve(storage_size);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+std::size_t
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+capacity()
+const
+noexcept
+{
+  return m_storage.capacity() / address::block_size * (address::block_size - 1);
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+shrink_to_fit()
+{
+  payloads().shrink_to_fit();
+  m_storage.shrink_to_fit();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
+inline
+void
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
+clear()
+noexcept(std::is_nothrow_destructible<T>::value)
+{
+  payloads().clear();
+  m_storage.clear();
+}
+
+template <std::size_t block_size, typename T, typename V, typename Compare,
+                                  typename Allocator, std::size_t arity, typename Storage>
 inline
 bool
-prio_queue<block_size, T, V, Compare, Allocator>::
+prio_queue<block_size, T, V, Compare, Allocator, arity, Storage>::
 sorts_before(value_type const &lv, value_type const &rv)
 const
 noexcept
@@ -647,95 +3750,204 @@ noexcept
 namespace prio_q_internal
 {
 
-template <std::size_t blocking>
+template <std::size_t blocking, std::size_t d>
 inline
 std::size_t
-heap_heap_addressing<blocking>::
+heap_heap_addressing<blocking, d>::
 child_of(std::size_t node_no)
 noexcept
 {
-  if (rollbear_prio_q_likely(!is_block_leaf(node_no)))
+  auto const child = arity * (block_offset(node_no) - 1) + 2;
+  if (rollbear_prio_q_likely(child < block_size))
+  {
+    return block_base(node_no) + child;
+  }
+  return child_block_root(node_no, child - block_size);
+}
+
+template <std::size_t blocking, std::size_t d>
+inline
+std::size_t
+heap_heap_addressing<blocking, d>::
+next_sibling(std::size_t node_no)
+noexcept
+{
+  auto const offset = block_offset(node_no);
+  if (rollbear_prio_q_unlikely(offset == 1U))
+  {
+    return node_no + block_size;
+  }
+  if (rollbear_prio_q_likely(offset != block_mask))
   {
-    return node_no + block_offset(node_no);
+    return node_no + 1;
   }
-  auto base = block_base(node_no) + 1;
-  return base * block_size + child_no(node_no) * block_size * 2 + 1;
+  // The last in-block child. The rest are in the first child block.
+  return child_block_root(node_no, 0);
 }
 
-template <std::size_t blocking>
+template <std::size_t blocking, std::size_t d>
 inline
 std::size_t
-heap_heap_addressing<blocking>::
+heap_heap_addressing<blocking, d>::
 parent_of(std::size_t node_no)
 noexcept
 {
-  auto const node_root = block_base(node_no); // 16
+  auto const node_root = block_base(node_no);
   if (rollbear_prio_q_likely(!is_block_root(node_no)))
   {
-    return node_root + block_offset(node_no) / 2;
+    return node_root + (block_offset(node_no) - 2) / arity + 1;
   }
-  auto const parent_base = block_base(node_root / block_size - 1); // 0
-  auto const child       =
-                 ((node_no - block_size) / block_size - parent_base) / 2;
-  return parent_base + block_size / 2 + child; // 30
+  auto const block        = node_root / block_size - 1;
+  auto const parent_block = block / fanout;
+  auto const child        = block % fanout + block_size;
+  return parent_block * block_size + (child - 2) / arity + 1;
 }
 
-template <std::size_t blocking>
+template <std::size_t blocking, std::size_t d>
 inline
 bool
-heap_heap_addressing<blocking>::
+heap_heap_addressing<blocking, d>::
 is_block_root(std::size_t node_no)
 noexcept
 {
   return block_offset(node_no) == 1U;
 }
 
-template <std::size_t blocking>
+template <std::size_t blocking, std::size_t d>
 inline
 std::size_t
-heap_heap_addressing<blocking>::
+heap_heap_addressing<blocking, d>::
 block_offset(std::size_t node_no)
 noexcept
 {
   return node_no & block_mask;
 }
 
-template <std::size_t blocking>
+template <std::size_t blocking, std::size_t d>
 inline
 std::size_t
-heap_heap_addressing<blocking>::
+heap_heap_addressing<blocking, d>::
 block_base(std::size_t node_no)
 noexcept
 {
   return node_no & ~block_mask;
 }
 
-template <std::size_t blocking>
+template <std::size_t blocking, std::size_t d>
 inline
 bool
-heap_heap_addressing<blocking>::
+heap_heap_addressing<blocking, d>::
 is_block_leaf(std::size_t node_no)
 noexcept
 {
-  return (node_no & (block_size >> 1)) != 0U;
+  return arity * (block_offset(node_no) - 1) + 2 >= block_size;
+}
+
+template <std::size_t blocking, std::size_t d>
+inline
+bool
+heap_heap_addressing<blocking, d>::
+children_in_block(std::size_t node_no)
+noexcept
+{
+  return arity * block_offset(node_no) + 2 <= block_size;
 }
 
-template <std::size_t blocking>
+template <std::size_t blocking, std::size_t d>
 inline
 std::size_t
-heap_heap_addressing<blocking>::
-child_no(std::size_t node_no)
+heap_heap_addressing<blocking, d>::
+child_block_root(std::size_t node_no, std::size_t child)
 noexcept
 {
-  assert(is_block_leaf(node_no));
-  return node_no & (block_mask >> 1);
+  auto const block = node_no / block_size;
+  return (block * fanout + 1 + child) * block_size + 1;
+}
+} // namespace prio_q_internal
+
+namespace prio_q_internal
+{
+struct block_size_hint
+{
+  std::size_t key_size;
+  std::size_t payload_size;
+  std::size_t block_size;
+};
+
+constexpr
+std::size_t
+auto_block_size(std::size_t key_size, std::size_t payload_size,
+                std::size_t line_size, std::size_t arity)
+{
+  // The smallest block allowed for the arity.
+  std::size_t size = 2 * arity;
+#ifdef ROLLBEAR_PRIO_QUEUE_BLOCK_SIZES
+  // The measured hint for the smallest sizes at least as large as these.
+  constexpr block_size_hint hints[] = { ROLLBEAR_PRIO_QUEUE_BLOCK_SIZES };
+  block_size_hint const *best = nullptr;
+  for (auto const &hint : hints)
+  {
+    if (hint.key_size < key_size || hint.payload_size < payload_size) continue;
+    if (!best
+        || hint.key_size < best->key_size
+        || (hint.key_size == best->key_size
+            && hint.payload_size < best->payload_size))
+    {
+      best = &hint;
+    }
+  }
+  if (best) return best->block_size > size ? best->block_size : size;
+#endif
+  // The keys of a block, which a sift down compares level by level, within
+  // two cache lines, and the payloads, which it only moves one per level,
+  // within a few more.
+  while (size * 2 * key_size <= 2 * line_size
+         && size * 2 * (key_size + payload_size) <= 16 * line_size)
+  {
+    size *= 2;
+  }
+  return size;
 }
 } // namespace prio_q_internal
 
+// The block size prio_queue_auto<T, V> uses, from the sizes of the key and the
+// payload, and the cache line size.
+template <typename T, typename V, std::size_t arity = 2>
+struct auto_block_size
+  : std::integral_constant<std::size_t,
+      prio_q_internal::auto_block_size(sizeof(T),
+                                       prio_q_internal::payload_size<V>::value,
+                                       ROLLBEAR_PRIO_QUEUE_CACHE_LINE_SIZE,
+                                       arity)>
+{
+};
+
+template <typename T, typename V,
+          typename Compare = std::less<T>,
+          typename Allocator = std::allocator<T>,
+          std::size_t arity = 2,
+          typename Storage = contiguous_storage>
+using prio_queue_auto = prio_queue<auto_block_size<T, V, arity>::value, T, V,
+                                   Compare, Allocator, arity, Storage>;
+
+#ifdef ROLLBEAR_PRIO_QUEUE_PMR
+namespace pmr
+{
+template <std::size_t block_size, typename T, typename V,
+                                  typename Compare = std::less<T>,
+                                  std::size_t arity = 2,
+                                  typename Storage = contiguous_storage>
+using prio_queue = rollbear::prio_queue<block_size, T, V, Compare,
+                                        std::pmr::polymorphic_allocator<T>,
+                                        arity, Storage>;
+} // namespace pmr
+#endif
 
 } // namespace rollbear
 
 #undef rollbear_prio_q_likely
 #undef rollbear_prio_q_unlikely
+#undef rollbear_prio_q_simd
+#undef rollbear_prio_q_prefetch
 
 #endif //ROLLBEAR_PRIO_QUEUE_HPP
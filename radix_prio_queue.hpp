@@ -0,0 +1,335 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_RADIX_PRIO_QUEUE_HPP
+#define ROLLBEAR_RADIX_PRIO_QUEUE_HPP
+
+#include "prio_queue.hpp"
+#include <array>
+#include <vector>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <cassert>
+#include <cstddef>
+
+namespace rollbear
+{
+namespace prio_q_internal
+{
+
+// The number of significant bits in n, i.e. 0 for 0, 1 for 1, 2 for 2 and 3,
+// and so on.
+inline
+std::size_t
+bit_width(unsigned long long n) noexcept
+{
+#if defined(__GNUC__)
+  return n ? std::numeric_limits<unsigned long long>::digits
+             - static_cast<std::size_t>(__builtin_clzll(n))
+           : 0;
+#else
+  std::size_t w = 0;
+  for (; n; n >>= 1) ++w;
+  return w;
+#endif
+}
+
+// The index of the lowest set bit in n, which must not be 0.
+inline
+std::size_t
+lowest_bit(unsigned long long n) noexcept
+{
+  assert(n != 0);
+#if defined(__GNUC__)
+  return static_cast<std::size_t>(__builtin_ctzll(n));
+#else
+  std::size_t i = 0;
+  for (; !(n & 1); n >>= 1) ++i;
+  return i;
+#endif
+}
+
+// The bits of an integral key, as an unsigned value that orders the same.
+// The sign bit of signed keys is flipped, so that they order as unsigned.
+template <typename T>
+inline
+std::make_unsigned_t<T>
+radix_bits(T t) noexcept
+{
+  using bits_type = std::make_unsigned_t<T>;
+  constexpr bits_type sign_bit
+    = std::is_signed<T>::value
+      ? bits_type(1) << (std::numeric_limits<bits_type>::digits - 1)
+      : 0;
+  return static_cast<bits_type>(t) ^ sign_bit;
+}
+
+} // namespace prio_q_internal
+
+// A radix heap with the interface of prio_queue<>, ordered by std::less<T>,
+// for integral keys only, and for monotone use only: no key pushed may be
+// smaller than the last key popped, which is asserted in debug builds. This
+// is what timer wheels and discrete event simulations do.
+//
+// Element e is kept in the bucket given by the highest bit in which its key
+// differs from the last popped key. pop() takes the lowest non empty bucket,
+// and spreads its elements over lower buckets relative to the new minimum,
+// so every element is moved at most once per bit of the key, and buckets are
+// scanned and appended to sequentially.
+template <typename T, typename V>
+class radix_prio_queue
+{
+  static_assert(std::is_integral<T>::value,
+                "radix_prio_queue requires an integral key type");
+  using bits_type = std::make_unsigned_t<T>;
+  static constexpr std::size_t num_buckets
+    = std::numeric_limits<bits_type>::digits + 1;
+  using element = prio_q_internal::element<T, V>;
+  using bucket = std::vector<typename element::type>;
+public:
+  using value_type = T;
+  using payload_type = V;
+
+  template <typename U, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  push(U &&u);
+
+  template <typename U, typename X>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  push(U &&key, X &&value);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, value_type const &>
+  top() const noexcept;
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+  top() noexcept;
+
+  void pop();
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value>
+  reschedule_top(T t);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value>
+  reschedule_top(T t);
+
+  bool empty() const noexcept;
+
+  std::size_t size() const noexcept;
+
+  void clear() noexcept;
+private:
+  template <typename E>
+  void insert(E &&e);
+
+  std::size_t bucket_of(T t) const noexcept;
+
+  void find_top() noexcept;
+
+  std::array<bucket, num_buckets> m_buckets;
+  std::size_t                     m_size = 0;
+  // The key last popped, or the lowest possible before the first pop.
+  bits_type                       m_last = 0;
+  // Where the smallest element is, valid when not empty.
+  std::size_t                     m_top_bucket = 0;
+  std::size_t                     m_top_idx = 0;
+};
+
+template <typename T, typename V>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+radix_prio_queue<T, V>::
+push(U &&u)
+{
+  insert(T(std::forward<U>(u)));
+}
+
+template <typename T, typename V>
+template <typename U, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+radix_prio_queue<T, V>::
+push(U &&key, X &&value)
+{
+  insert(typename element::type(std::forward<U>(key), std::forward<X>(value)));
+}
+
+template <typename T, typename V>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value, T const &>
+radix_prio_queue<T, V>::
+top() const noexcept
+{
+  assert(!empty());
+  return m_buckets[m_top_bucket][m_top_idx];
+}
+
+template <typename T, typename V>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+radix_prio_queue<T, V>::
+top() noexcept
+{
+  assert(!empty());
+  auto &e = m_buckets[m_top_bucket][m_top_idx];
+  return { e.first, e.second };
+}
+
+template <typename T, typename V>
+void
+radix_prio_queue<T, V>::
+pop()
+{
+  assert(!empty());
+  auto &b = m_buckets[m_top_bucket];
+  m_last = prio_q_internal::radix_bits(element::key(b[m_top_idx]));
+  if (m_top_idx != b.size() - 1)
+  {
+    b[m_top_idx] = std::move(b.back());
+  }
+  b.pop_back();
+  if (m_top_bucket != 0)
+  {
+    // The rest of the bucket now differs from the last key in a lower bit,
+    // so no element stays, and the new smallest lands in bucket 0. The
+    // bucket keeps its memory for the next time it is filled.
+    for (auto &e : b)
+    {
+      m_buckets[bucket_of(element::key(e))].push_back(std::move(e));
+    }
+    b.clear();
+  }
+  --m_size;
+  find_top();
+}
+
+template <typename T, typename V>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value>
+radix_prio_queue<T, V>::
+reschedule_top(T t)
+{
+  auto value = std::move(top().second);
+  pop();
+  push(std::move(t), std::move(value));
+}
+
+template <typename T, typename V>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value>
+radix_prio_queue<T, V>::
+reschedule_top(T t)
+{
+  pop();
+  push(std::move(t));
+}
+
+template <typename T, typename V>
+inline
+bool
+radix_prio_queue<T, V>::
+empty()
+const
+noexcept
+{
+  return m_size == 0;
+}
+
+template <typename T, typename V>
+inline
+std::size_t
+radix_prio_queue<T, V>::
+size()
+const
+noexcept
+{
+  return m_size;
+}
+
+template <typename T, typename V>
+inline
+void
+radix_prio_queue<T, V>::
+clear()
+noexcept
+{
+  for (auto &b : m_buckets) b.clear();
+  m_size = 0;
+  m_last = 0;
+}
+
+template <typename T, typename V>
+template <typename E>
+inline
+void
+radix_prio_queue<T, V>::
+insert(E &&e)
+{
+  auto const key = element::key(e);
+  assert(!(prio_q_internal::radix_bits(key) < m_last)
+         && "radix_prio_queue keys must not decrease");
+  auto const b = bucket_of(key);
+  m_buckets[b].push_back(std::forward<E>(e));
+  if (m_size++ == 0
+      || key < element::key(m_buckets[m_top_bucket][m_top_idx]))
+  {
+    m_top_bucket = b;
+    m_top_idx = m_buckets[b].size() - 1;
+  }
+}
+
+template <typename T, typename V>
+inline
+std::size_t
+radix_prio_queue<T, V>::
+bucket_of(T t)
+const
+noexcept
+{
+  return prio_q_internal::bit_width(prio_q_internal::radix_bits(t) ^ m_last);
+}
+
+template <typename T, typename V>
+void
+radix_prio_queue<T, V>::
+find_top()
+noexcept
+{
+  if (m_size == 0) return;
+  std::size_t b = 0;
+  while (m_buckets[b].empty()) ++b;
+  auto const &elements = m_buckets[b];
+  std::size_t idx = elements.size() - 1;
+  if (b != 0)
+  {
+    for (std::size_t i = 0; i != elements.size(); ++i)
+    {
+      if (element::key(elements[i]) < element::key(elements[idx])) idx = i;
+    }
+  }
+  m_top_bucket = b;
+  m_top_idx = idx;
+}
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_RADIX_PRIO_QUEUE_HPP
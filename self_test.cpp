@@ -13,7 +13,23 @@
 
 
 #include "prio_queue.hpp"
+#include "addressable_prio_queue.hpp"
+#include "multi_queue.hpp"
+#include "flat_combining_prio_queue.hpp"
+#include "mmap_storage.hpp"
+#include "radix_prio_queue.hpp"
+#include "timer_queue.hpp"
+#include "indirect_prio_queue.hpp"
+#include "external_prio_queue.hpp"
 #include <queue>
+#include <array>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <csignal>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
@@ -134,6 +150,84 @@ TEST_CASE("Obtaining parent", "[addressing]")
   REQUIRE(A::parent_of(1097) == 140);
 }
 
+TEST_CASE("4-ary blocks spill the children of a node over to child blocks",
+          "[addressing]")
+{
+  using A4 = rollbear::prio_q_internal::heap_heap_addressing<16, 4>;
+  std::size_t const fanout = A4::fanout;
+  REQUIRE(fanout == 46);
+  REQUIRE(A4::child_of(1) == 2);
+  REQUIRE(A4::child_of(2) == 6);
+  REQUIRE(A4::child_of(3) == 10);
+  REQUIRE(!A4::is_block_leaf(4));
+  REQUIRE(A4::is_block_leaf(5));
+  REQUIRE(A4::child_of(4) == 14);
+  REQUIRE(A4::next_sibling(14) == 15);
+  REQUIRE(A4::next_sibling(15) == 17);
+  REQUIRE(A4::next_sibling(17) == 33);
+  REQUIRE(A4::child_of(5) == 49);
+  REQUIRE(A4::parent_of(15) == 4);
+  REQUIRE(A4::parent_of(17) == 4);
+  REQUIRE(A4::parent_of(33) == 4);
+  REQUIRE(A4::parent_of(49) == 5);
+}
+
+template <typename Addressing>
+void check_every_node_has_one_parent(std::size_t last_idx)
+{
+  std::vector<int> parents(last_idx + 1);
+  for (std::size_t idx = 1; idx <= last_idx; ++idx)
+  {
+    if (Addressing::block_offset(idx) == 0) continue;
+    auto child = Addressing::child_of(idx);
+    for (std::size_t i = 0; i != Addressing::arity && child <= last_idx; ++i)
+    {
+      REQUIRE(child > idx);
+      REQUIRE(Addressing::parent_of(child) == idx);
+      ++parents[child];
+      child = Addressing::next_sibling(child);
+    }
+  }
+  for (std::size_t idx = 2; idx <= last_idx; ++idx)
+  {
+    REQUIRE(parents[idx] == (Addressing::block_offset(idx) != 0));
+  }
+}
+
+TEST_CASE("every node but the root has exactly one parent, for all arities",
+          "[addressing]")
+{
+  using namespace rollbear::prio_q_internal;
+  check_every_node_has_one_parent<heap_heap_addressing<2, 2>>(5000);
+  check_every_node_has_one_parent<heap_heap_addressing<4, 2>>(5000);
+  check_every_node_has_one_parent<heap_heap_addressing<8, 2>>(5000);
+  check_every_node_has_one_parent<heap_heap_addressing<8, 4>>(5000);
+  check_every_node_has_one_parent<heap_heap_addressing<16, 4>>(5000);
+  check_every_node_has_one_parent<heap_heap_addressing<32, 8>>(20000);
+  check_every_node_has_one_parent<heap_heap_addressing<64, 16>>(20000);
+}
+
+TEST_CASE("auto block sizes are valid for the arity", "[auto]")
+{
+  using rollbear::auto_block_size;
+  auto const valid = [](std::size_t size, std::size_t arity) {
+    return (size & (size - 1)) == 0 && size >= 2 * arity;
+  };
+  REQUIRE(valid(auto_block_size<int, void>::value, 2));
+  REQUIRE(valid(auto_block_size<double, std::string>::value, 2));
+  REQUIRE(valid(auto_block_size<char, std::array<char, 4096>>::value, 2));
+  REQUIRE(valid(auto_block_size<int, int, 8>::value, 8));
+  REQUIRE(valid(auto_block_size<std::int64_t, void, 16>::value, 16));
+
+  rollbear::prio_queue_auto<int, std::string> q;
+  for (int i = 0; i < 100; ++i) q.push((i * 37) % 100, std::to_string(i));
+  for (int i = 0; i < 100; ++i)
+  {
+    REQUIRE(q.top().first == i);
+    q.pop();
+  }
+}
+
 TEST_CASE("a default constructed queue is empty", "[empty]")
 {
   prio_queue<16, int, void> q;
@@ -590,3 +684,2428 @@ TEST_CASE("throwing copy allows safe destruction", "[nontrivial]")
   REQUIRE_FALSE(too_soon);
   REQUIRE(obj_count == 0);
 }
+
+TEST_CASE("a queue constructed from an empty range is empty", "[bulk]")
+{
+  std::vector<int> v;
+  prio_queue<16, int, void> q(v.begin(), v.end());
+  REQUIRE(q.empty());
+  REQUIRE(q.size() == 0);
+}
+
+TEST_CASE("a queue constructed from a range pops it sorted", "[bulk]")
+{
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<> dist(1,100000);
+  for (std::size_t size : { 1U, 2U, 3U, 7U, 8U, 9U, 63U, 64U, 65U, 4711U })
+  {
+    std::vector<int> v(size);
+    for (auto& i : v) i = dist(gen);
+    prio_queue<8, int, void> q(v.begin(), v.end());
+    REQUIRE(q.size() == size);
+    std::sort(v.begin(), v.end());
+    for (auto i : v)
+    {
+      REQUIRE(q.top() == i);
+      q.pop();
+    }
+    REQUIRE(q.empty());
+  }
+}
+
+TEST_CASE("a range of pairs is split into keys and payloads", "[bulk]")
+{
+  std::vector<std::pair<int, std::unique_ptr<int>>> v;
+  for (int i = 0; i < 300; ++i)
+  {
+    int k = (i * 7919) % 300;
+    v.emplace_back(k, std::make_unique<int>(-k));
+  }
+  prio_queue<4, int, std::unique_ptr<int>> q(std::make_move_iterator(v.begin()),
+                                             std::make_move_iterator(v.end()));
+  REQUIRE(q.size() == 300);
+  for (int i = 0; i < 300; ++i)
+  {
+    REQUIRE(q.top().first == i);
+    REQUIRE(*q.top().second == -i);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("assign replaces the contents of a queue", "[bulk]")
+{
+  prio_queue<16, int, int> q;
+  q.push(1, -1);
+  q.push(2, -2);
+  std::pair<int, int> v[] = { { 9, -9 }, { 5, -5 }, { 7, -7 } };
+  q.assign(std::begin(v), std::end(v));
+  REQUIRE(q.size() == 3);
+  REQUIRE(q.top().first == 5);
+  REQUIRE(q.top().second == -5);
+  q.pop();
+  REQUIRE(q.top().first == 7);
+  REQUIRE(q.top().second == -7);
+  q.pop();
+  REQUIRE(q.top().first == 9);
+  REQUIRE(q.top().second == -9);
+  q.pop();
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("push_range of a small batch keeps the heap ordered", "[bulk]")
+{
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<> dist(1,100000);
+  prio_queue<8, int, int> q;
+  std::vector<int> all;
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto k = dist(gen);
+    q.push(k, -k);
+    all.push_back(k);
+  }
+  std::vector<std::pair<int, int>> batch;
+  for (int i = 0; i < 100; ++i)
+  {
+    auto k = dist(gen);
+    batch.emplace_back(k, -k);
+    all.push_back(k);
+  }
+  q.push_range(batch.begin(), batch.end());
+  REQUIRE(q.size() == all.size());
+  std::sort(all.begin(), all.end());
+  for (auto i : all)
+  {
+    REQUIRE(q.top().first == i);
+    REQUIRE(q.top().second == -i);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("push_range of a large batch rebuilds the heap", "[bulk]")
+{
+  prio_queue<4, int, void> q;
+  q.push(3);
+  q.push(1);
+  std::vector<int> batch;
+  for (int i = 200; i > 1; --i) batch.push_back(i);
+  q.push_range(batch.begin(), batch.end());
+  REQUIRE(q.size() == 201);
+  std::vector<int> expected(batch);
+  expected.push_back(3);
+  expected.push_back(1);
+  std::sort(expected.begin(), expected.end());
+  for (auto i : expected)
+  {
+    REQUIRE(q.top() == i);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+namespace {
+// Throws from its copy constructor once copies_left reaches 0.
+int copies_left = -1;
+
+struct throwing_copy
+{
+  throwing_copy(int v) : value(v) { }
+  throwing_copy(throwing_copy const &other) : value(other.value)
+  {
+    if (copies_left == 0) throw std::runtime_error("copy");
+    if (copies_left > 0) --copies_left;
+  }
+  throwing_copy(throwing_copy &&) noexcept = default;
+  throwing_copy &operator=(throwing_copy const &) = default;
+  throwing_copy &operator=(throwing_copy &&) noexcept = default;
+  friend bool operator<(throwing_copy const &l, throwing_copy const &r) noexcept
+  {
+    return l.value < r.value;
+  }
+  int value;
+};
+
+int value_of(int v) { return v; }
+int value_of(throwing_copy const &v) { return v.value; }
+
+template <typename K, typename V, typename F>
+void check_throwing_bulk_insert(F insert)
+{
+  prio_queue<8, K, V> q;
+  for (int i = 0; i < 50; ++i) q.push(i * 2 + 1, -(i * 2 + 1));
+  std::vector<std::pair<K, V>> batch;
+  for (int i = 0; i < 100; ++i) batch.emplace_back(200 - i * 2, i * 2 - 200);
+  copies_left = 30;
+  REQUIRE_THROWS_AS(insert(q, batch), std::runtime_error);
+  copies_left = -1;
+  int last = std::numeric_limits<int>::min();
+  while (!q.empty())
+  {
+    int const key = value_of(q.top().first);
+    int const value = value_of(q.top().second);
+    REQUIRE(key >= last);
+    REQUIRE(value == -key);
+    last = key;
+    q.pop();
+  }
+}
+
+template <typename K, typename V>
+void check_throwing_bulk_inserts()
+{
+  check_throwing_bulk_insert<K, V>([](auto &q, auto const &b) {
+    q.push_range(b.begin(), b.end());
+  });
+  check_throwing_bulk_insert<K, V>([](auto &q, auto const &b) {
+    q.push_range(b.begin(), b.begin() + 40);
+  });
+  check_throwing_bulk_insert<K, V>([](auto &q, auto const &b) {
+    q.assign(b.begin(), b.end());
+  });
+}
+}
+
+TEST_CASE("a throwing copy in push_range or assign leaves a heap", "[bulk]")
+{
+  // The payload throws, and the key after its payload is stored.
+  check_throwing_bulk_inserts<int, throwing_copy>();
+  check_throwing_bulk_inserts<throwing_copy, int>();
+}
+
+TEST_CASE("a default constructed queue has no capacity", "[capacity]")
+{
+  prio_queue<16, int, int> q;
+  REQUIRE(q.capacity() == 0);
+}
+
+TEST_CASE("reserve makes room for pushes without growing", "[capacity]")
+{
+  prio_queue<16, int, std::unique_ptr<int>> q;
+  q.reserve(1000);
+  auto const capacity = q.capacity();
+  REQUIRE(capacity >= 1000);
+  REQUIRE(capacity < 1000 + 15);
+  for (int i = 0; i < 1000; ++i)
+  {
+    q.push(1000 - i, std::make_unique<int>(i));
+  }
+  REQUIRE(q.capacity() == capacity);
+  REQUIRE(q.top().first == 1);
+  REQUIRE(*q.top().second == 999);
+}
+
+TEST_CASE("capacity counts elements, not slots", "[capacity]")
+{
+  prio_queue<4, int, void> q;
+  q.reserve(3);
+  REQUIRE(q.capacity() == 3);
+  q.reserve(4);
+  REQUIRE(q.capacity() == 6);
+}
+
+TEST_CASE("clear empties the queue but keeps the capacity", "[capacity]")
+{
+  prio_queue<8, int, std::unique_ptr<int>> q;
+  for (int i = 0; i < 100; ++i)
+  {
+    q.push(i, std::make_unique<int>(i));
+  }
+  auto const capacity = q.capacity();
+  q.clear();
+  REQUIRE(q.empty());
+  REQUIRE(q.size() == 0);
+  REQUIRE(q.capacity() == capacity);
+  q.push(3, std::make_unique<int>(-3));
+  q.push(2, std::make_unique<int>(-2));
+  REQUIRE(q.top().first == 2);
+  REQUIRE(*q.top().second == -2);
+}
+
+TEST_CASE("shrink_to_fit releases unused capacity", "[capacity]")
+{
+  prio_queue<8, int, int> q;
+  for (int i = 0; i < 1000; ++i)
+  {
+    q.push(i, -i);
+  }
+  for (int i = 0; i < 990; ++i)
+  {
+    q.pop();
+  }
+  q.shrink_to_fit();
+  REQUIRE(q.capacity() >= 10);
+  REQUIRE(q.capacity() < 10 + 7);
+  for (int i = 990; i < 1000; ++i)
+  {
+    REQUIRE(q.top().first == i);
+    REQUIRE(q.top().second == -i);
+    q.pop();
+  }
+  q.shrink_to_fit();
+  REQUIRE(q.capacity() == 0);
+}
+
+TEST_CASE("decreasing the key of a handle moves it to the top", "[addressable]")
+{
+  rollbear::addressable_prio_queue<4, int, int> q;
+  std::vector<std::size_t> handles;
+  for (int i = 0; i < 50; ++i)
+  {
+    handles.push_back(q.push(i + 10, i));
+  }
+  REQUIRE(q.top().first == 10);
+  q.update(handles[37], 1);
+  REQUIRE(q.top().first == 1);
+  REQUIRE(q.top().second == 37);
+  REQUIRE(q.top_handle() == handles[37]);
+  REQUIRE(q.key(handles[36]) == 46);
+  REQUIRE(q.value(handles[36]) == 36);
+}
+
+TEST_CASE("increasing the key of the top handle moves it down", "[addressable]")
+{
+  rollbear::addressable_prio_queue<8, int, void> q;
+  auto h = q.push(1);
+  q.push(2);
+  q.push(3);
+  q.update(h, 4);
+  REQUIRE(q.top() == 2);
+  q.pop();
+  REQUIRE(q.top() == 3);
+  q.pop();
+  REQUIRE(q.top() == 4);
+  REQUIRE(q.top_handle() == h);
+  q.pop();
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("random updates and erases of handles match a reference",
+          "[addressable]")
+{
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<> dist(1, 10000);
+  rollbear::addressable_prio_queue<8, int, std::unique_ptr<int>> q;
+  std::map<std::size_t, int> live;
+  for (int i = 0; i < 5000; ++i)
+  {
+    auto op = gen() % 4;
+    if (op < 2 || live.empty())
+    {
+      auto k = dist(gen);
+      auto h = q.push(k, std::make_unique<int>(k));
+      REQUIRE(live.count(h) == 0);
+      live[h] = k;
+    }
+    else
+    {
+      auto it = live.begin();
+      std::advance(it, gen() % live.size());
+      if (op == 2)
+      {
+        auto k = dist(gen);
+        q.update(it->first, k);
+        *q.value(it->first) = k;
+        it->second = k;
+      }
+      else
+      {
+        q.erase(it->first);
+        live.erase(it);
+      }
+    }
+    REQUIRE(q.size() == live.size());
+    if (!live.empty())
+    {
+      auto min = std::min_element(live.begin(), live.end(),
+                                  [](auto const& l, auto const& r) { return l.second < r.second; });
+      REQUIRE(q.top().first == min->second);
+      REQUIRE(*q.top().second == q.top().first);
+      REQUIRE(q.key(min->first) == min->second);
+    }
+  }
+  while (!q.empty())
+  {
+    auto h = q.top_handle();
+    REQUIRE(live[h] == q.top().first);
+    live.erase(h);
+    q.pop();
+  }
+  REQUIRE(live.empty());
+}
+
+TEST_CASE("an empty multi_queue pops nothing", "[multi_queue]")
+{
+  rollbear::multi_queue<16, int, int> q(4);
+  REQUIRE(q.num_shards() == 8);
+  REQUIRE(q.empty());
+  int k = 0;
+  int v = 0;
+  REQUIRE_FALSE(q.try_pop(k, v));
+}
+
+TEST_CASE("a multi_queue pops every pushed element", "[multi_queue]")
+{
+  rollbear::multi_queue<8, int, void> q(2, 4);
+  std::vector<int> pushed;
+  for (int i = 0; i < 1000; ++i)
+  {
+    q.push(i * 7 % 1000);
+    pushed.push_back(i * 7 % 1000);
+  }
+  REQUIRE(q.size() == 1000);
+  std::vector<int> popped;
+  int k;
+  while (q.try_pop(k))
+  {
+    popped.push_back(k);
+  }
+  REQUIRE(q.empty());
+  std::sort(pushed.begin(), pushed.end());
+  std::sort(popped.begin(), popped.end());
+  REQUIRE(popped == pushed);
+}
+
+TEST_CASE("a multi_queue pops close to the best element", "[multi_queue]")
+{
+  rollbear::multi_queue<8, int, int> q(1, 2);
+  for (int i = 0; i < 1000; ++i)
+  {
+    q.push(i, -i);
+  }
+  int k;
+  int v;
+  for (int i = 0; i < 500; ++i)
+  {
+    REQUIRE(q.try_pop(k, v));
+    REQUIRE(v == -k);
+    REQUIRE(k < i + 50);
+  }
+}
+
+namespace {
+// Orders by < or >, as chosen when constructed.
+struct flip_compare
+{
+  bool descending = false;
+  bool operator()(int l, int r) const { return descending ? r < l : l < r; }
+};
+}
+
+TEST_CASE("every shard of a multi_queue orders by its comparator",
+          "[multi_queue]")
+{
+  // With two shards, both tops are compared, so the order is exact.
+  rollbear::multi_queue<8, int, void, flip_compare> q(1, 1, flip_compare{true});
+  for (int i = 0; i < 1000; ++i) q.push((i * 37) % 1000);
+  int k;
+  for (int i = 999; i >= 0; --i)
+  {
+    REQUIRE(q.try_pop(k));
+    REQUIRE(k == i);
+  }
+  REQUIRE_FALSE(q.try_pop(k));
+}
+
+TEST_CASE("concurrent pushes and pops on a multi_queue lose nothing",
+          "[multi_queue]")
+{
+  constexpr int num_threads = 4;
+  constexpr int per_thread = 20000;
+  rollbear::multi_queue<16, int, int> q(num_threads);
+  std::vector<std::vector<int>> popped(num_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t)
+  {
+    threads.emplace_back([&q, &popped, t] {
+      int k;
+      int v;
+      for (int i = 0; i < per_thread; ++i)
+      {
+        q.push(t * per_thread + i, i);
+        if (i % 2 && q.try_pop(k, v)) popped[t].push_back(k);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  int k;
+  int v;
+  while (q.try_pop(k, v)) popped[0].push_back(k);
+  std::vector<int> all;
+  for (auto& p : popped) all.insert(all.end(), p.begin(), p.end());
+  std::sort(all.begin(), all.end());
+  REQUIRE(all.size() == num_threads * per_thread);
+  for (int i = 0; i < num_threads * per_thread; ++i)
+  {
+    REQUIRE(all[i] == i);
+  }
+}
+
+TEST_CASE("an empty flat_combining_prio_queue pops nothing",
+          "[flat_combining]")
+{
+  rollbear::flat_combining_prio_queue<16, int, int> q(4);
+  REQUIRE(q.empty());
+  int k = 0;
+  int v = 0;
+  REQUIRE_FALSE(q.try_pop(k, v));
+}
+
+TEST_CASE("a flat_combining_prio_queue pops in strict order",
+          "[flat_combining]")
+{
+  rollbear::flat_combining_prio_queue<8, int, void> q(1);
+  for (int i = 0; i < 1000; ++i)
+  {
+    q.push(i * 7 % 1000);
+  }
+  REQUIRE(q.size() == 1000);
+  int k;
+  for (int i = 0; i < 1000; ++i)
+  {
+    REQUIRE(q.try_pop(k));
+    REQUIRE(k == i);
+  }
+  REQUIRE(q.empty());
+  REQUIRE_FALSE(q.try_pop(k));
+}
+
+TEST_CASE("a flat_combining_prio_queue moves payloads in and out",
+          "[flat_combining]")
+{
+  rollbear::flat_combining_prio_queue<8, int, std::unique_ptr<int>> q(1);
+  for (int i = 0; i < 100; ++i)
+  {
+    q.push(i * 13 % 100, std::make_unique<int>(i * 13 % 100));
+  }
+  int k;
+  std::unique_ptr<int> v;
+  for (int i = 0; i < 100; ++i)
+  {
+    REQUIRE(q.try_pop(k, v));
+    REQUIRE(k == i);
+    REQUIRE(v);
+    REQUIRE(*v == i);
+  }
+}
+
+TEST_CASE("concurrent pushes and pops on a flat_combining_prio_queue lose "
+          "nothing, also with more threads than slots",
+          "[flat_combining]")
+{
+  constexpr int num_threads = 4;
+  constexpr int per_thread = 20000;
+  rollbear::flat_combining_prio_queue<16, int, int> q(num_threads / 2);
+  std::vector<std::vector<int>> popped(num_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t)
+  {
+    threads.emplace_back([&q, &popped, t] {
+      int k;
+      int v;
+      for (int i = 0; i < per_thread; ++i)
+      {
+        q.push(t * per_thread + i, -(t * per_thread + i));
+        if (i % 2 && q.try_pop(k, v)) popped[t].push_back(k == -v ? k : -1);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  int k;
+  int v;
+  while (q.try_pop(k, v)) popped[0].push_back(k);
+  std::vector<int> all;
+  for (auto& p : popped) all.insert(all.end(), p.begin(), p.end());
+  std::sort(all.begin(), all.end());
+  REQUIRE(all.size() == num_threads * per_thread);
+  for (int i = 0; i < num_threads * per_thread; ++i)
+  {
+    REQUIRE(all[i] == i);
+  }
+}
+
+template <std::size_t block_size, std::size_t arity,
+          typename Storage = rollbear::contiguous_storage>
+void check_random_operations_match_reference()
+{
+  std::mt19937 gen(block_size * arity);
+  std::uniform_int_distribution<int> dist(0, 10000);
+  prio_queue<block_size, int, int, std::less<int>, std::allocator<int>, arity,
+             Storage> q;
+  std::multimap<int, int> reference;
+  for (int i = 0; i < 20000; ++i)
+  {
+    auto const op = gen() % 8;
+    if (op < 4 || reference.empty())
+    {
+      auto k = dist(gen);
+      q.push(k, -k);
+      reference.emplace(k, -k);
+    }
+    else if (op < 7)
+    {
+      REQUIRE(q.top().first == reference.begin()->first);
+      REQUIRE(q.top().second == -q.top().first);
+      q.pop();
+      reference.erase(reference.begin());
+    }
+    else
+    {
+      auto k = dist(gen);
+      REQUIRE(q.top().first == reference.begin()->first);
+      q.top().second = -k;
+      q.reschedule_top(k);
+      reference.erase(reference.begin());
+      reference.emplace(k, -k);
+    }
+    REQUIRE(q.size() == reference.size());
+  }
+  std::vector<std::pair<int, int>> range(reference.begin(), reference.end());
+  std::shuffle(range.begin(), range.end(), gen);
+  q.assign(range.begin(), range.end());
+  for (auto& e : reference)
+  {
+    REQUIRE(q.top().first == e.first);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+namespace {
+struct move_counted
+{
+  move_counted(int v, std::string s) : value(v), name(std::move(s)) {}
+  move_counted(move_counted &&m) noexcept
+    : value(m.value), name(std::move(m.name)) { ++moves; }
+  move_counted &operator=(move_counted &&m) noexcept
+  {
+    value = m.value;
+    name = std::move(m.name);
+    ++moves;
+    return *this;
+  }
+  int value;
+  std::string name;
+  static int moves;
+};
+int move_counted::moves = 0;
+}
+
+TEST_CASE("emplace constructs the payload in place", "[emplace]")
+{
+  prio_queue<16, int, move_counted> q;
+  q.reserve(100);
+  move_counted::moves = 0;
+  q.push(4, move_counted(4, "four"));
+  auto const push_moves = move_counted::moves;
+  q.pop();
+  move_counted::moves = 0;
+  q.emplace(3, 3, "three");
+  REQUIRE(move_counted::moves == push_moves - 1);
+  q.emplace(1, 1, "one");
+  q.emplace(2, 2, "two");
+  REQUIRE(q.top().first == 1);
+  REQUIRE(q.top().second.value == 1);
+  REQUIRE(q.top().second.name == "one");
+  auto top = q.pop_value();
+  REQUIRE(top.first == 1);
+  REQUIRE(top.second.name == "one");
+  REQUIRE(q.pop_value().second.name == "two");
+  REQUIRE(q.pop_value().second.name == "three");
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("pop_value moves out the top in order", "[emplace]")
+{
+  prio_queue<8, int, void> q;
+  for (int i = 0; i < 100; ++i) q.push((i * 37) % 100);
+  for (int i = 0; i < 100; ++i)
+  {
+    REQUIRE(q.pop_value() == i);
+  }
+  REQUIRE(q.empty());
+
+  prio_queue<8, int, std::unique_ptr<int>> p;
+  for (int i = 0; i < 100; ++i)
+  {
+    auto k = (i * 37) % 100;
+    p.push(k, std::make_unique<int>(k));
+  }
+  for (int i = 0; i < 100; ++i)
+  {
+    auto top = p.pop_value();
+    REQUIRE(top.first == i);
+    REQUIRE(*top.second == i);
+  }
+  REQUIRE(p.empty());
+}
+
+TEST_CASE("replace_top changes both the key and the payload of the top",
+          "[emplace]")
+{
+  std::mt19937 gen(17);
+  std::uniform_int_distribution<int> dist(0, 10000);
+  prio_queue<16, int, std::unique_ptr<int>> q;
+  std::multiset<int> reference;
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto k = dist(gen);
+    q.push(k, std::make_unique<int>(-k));
+    reference.insert(k);
+  }
+  for (int i = 0; i < 5000; ++i)
+  {
+    REQUIRE(q.top().first == *reference.begin());
+    REQUIRE(*q.top().second == -q.top().first);
+    auto k = dist(gen);
+    reference.erase(reference.begin());
+    reference.insert(k);
+    if (i % 2)
+    {
+      q.replace_top(k, std::make_unique<int>(-k));
+    }
+    else
+    {
+      *q.top().second = -k;
+      q.replace_top(k, std::move(q.top().second));
+    }
+  }
+  for (auto k : reference)
+  {
+    auto top = q.pop_value();
+    REQUIRE(top.first == k);
+    REQUIRE(*top.second == -k);
+  }
+  REQUIRE(q.empty());
+}
+
+template <std::size_t block_size, std::size_t arity>
+void check_pop_n_matches_pop()
+{
+  std::mt19937 gen(block_size + arity);
+  std::uniform_int_distribution<int> dist(0, 1000);
+  for (int round = 0; round != 200; ++round)
+  {
+    prio_queue<block_size, int, int, std::less<int>, std::allocator<int>,
+               arity> q;
+    std::multimap<int, int> reference;
+    auto const size = gen() % 3000;
+    for (std::size_t i = 0; i != size; ++i)
+    {
+      auto k = dist(gen);
+      q.push(k, -k);
+      reference.emplace(k, -k);
+    }
+    while (!reference.empty())
+    {
+      auto const n = gen() % 600;
+      std::vector<std::pair<int, int>> popped;
+      q.pop_n(n, std::back_inserter(popped));
+      REQUIRE(popped.size() == std::min<std::size_t>(n, reference.size()));
+      for (auto &e : popped)
+      {
+        REQUIRE(e.first == reference.begin()->first);
+        REQUIRE(e.second == -e.first);
+        reference.erase(reference.begin());
+      }
+      REQUIRE(q.size() == reference.size());
+      if (!reference.empty())
+      {
+        REQUIRE(q.top().first == reference.begin()->first);
+      }
+    }
+    REQUIRE(q.empty());
+  }
+}
+
+TEST_CASE("pop_n gives the same elements as as many calls to pop",
+          "[pop_n]")
+{
+  check_pop_n_matches_pop<2, 2>();
+  check_pop_n_matches_pop<4, 2>();
+  check_pop_n_matches_pop<16, 2>();
+  check_pop_n_matches_pop<64, 2>();
+  check_pop_n_matches_pop<16, 4>();
+  check_pop_n_matches_pop<64, 8>();
+}
+
+TEST_CASE("pop_n leaves a queue that works as before", "[pop_n]")
+{
+  prio_queue<16, int, void> q;
+  for (int i = 0; i < 1000; ++i) q.push((i * 7919) % 1000);
+  std::vector<int> popped;
+  auto out = q.pop_n(100, std::back_inserter(popped));
+  q.pop_n(0, out);
+  REQUIRE(popped.size() == 100);
+  REQUIRE(std::is_sorted(popped.begin(), popped.end()));
+  REQUIRE(popped.back() == 99);
+  for (int i = 0; i < 100; ++i) q.push(i);
+  for (int i = 0; i < 1000; ++i)
+  {
+    REQUIRE(q.top() == i);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("drain empties the queue in order", "[pop_n]")
+{
+  prio_queue<16, int, std::unique_ptr<int>, std::greater<int>> q;
+  for (int i = 0; i < 500; ++i)
+  {
+    auto k = (i * 7919) % 500;
+    q.push(k, std::make_unique<int>(k));
+  }
+  std::vector<std::pair<int, std::unique_ptr<int>>> drained;
+  q.drain(std::back_inserter(drained));
+  REQUIRE(q.empty());
+  REQUIRE(drained.size() == 500);
+  for (int i = 0; i < 500; ++i)
+  {
+    REQUIRE(drained[i].first == 499 - i);
+    REQUIRE(*drained[i].second == 499 - i);
+  }
+  q.push(3, std::make_unique<int>(3));
+  REQUIRE(q.top().first == 3);
+}
+
+TEST_CASE("binary queues with blocks of a single node still work", "[arity]")
+{
+  check_random_operations_match_reference<2, 2>();
+  check_random_operations_match_reference<2, 2, rollbear::segmented_storage<64>>();
+}
+
+TEST_CASE("queues with wider trees in the blocks order like a binary one",
+          "[arity]")
+{
+  check_random_operations_match_reference<8, 4>();
+  check_random_operations_match_reference<16, 4>();
+  check_random_operations_match_reference<32, 4>();
+  check_random_operations_match_reference<32, 8>();
+  check_random_operations_match_reference<64, 8>();
+}
+
+template <typename T, typename Compare, std::size_t arity>
+void check_arithmetic_keys_pop_sorted()
+{
+  std::mt19937 gen(arity);
+  // a narrow range, to get many equal siblings
+  std::uniform_int_distribution<int> dist(-500, 500);
+  prio_queue<64, T, int, Compare, std::allocator<T>, arity> q;
+  std::vector<T> reference;
+  for (int i = 0; i < 5000; ++i)
+  {
+    auto k = static_cast<T>(dist(gen)) / T(2);
+    q.push(k, i);
+    reference.push_back(k);
+  }
+  std::sort(reference.begin(), reference.end(), Compare{});
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto k = q.top().first;
+    q.pop();
+    q.push(k, i);
+  }
+  for (auto k : reference)
+  {
+    REQUIRE(q.top().first == k);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+template <typename T>
+void check_arithmetic_keys_pop_sorted()
+{
+  check_arithmetic_keys_pop_sorted<T, std::less<T>, 4>();
+  check_arithmetic_keys_pop_sorted<T, std::less<T>, 8>();
+  check_arithmetic_keys_pop_sorted<T, std::less<T>, 16>();
+  check_arithmetic_keys_pop_sorted<T, std::greater<>, 4>();
+  check_arithmetic_keys_pop_sorted<T, std::greater<>, 8>();
+  check_arithmetic_keys_pop_sorted<T, std::greater<>, 16>();
+}
+
+TEST_CASE("arithmetic keys in wide blocks pop sorted either way", "[arity]")
+{
+  check_arithmetic_keys_pop_sorted<std::int32_t>();
+  check_arithmetic_keys_pop_sorted<std::int64_t>();
+  check_arithmetic_keys_pop_sorted<float>();
+  check_arithmetic_keys_pop_sorted<double>();
+}
+
+template <typename T, std::size_t n, int order>
+void check_simd_best_of()
+{
+  using kernel = rollbear::prio_q_internal::simd_best_of<T, n, order>;
+  if (!kernel::enabled) return;
+  std::mt19937 gen(n);
+  std::uniform_int_distribution<int> dist(-3, 3);
+  T keys[n];
+  for (int i = 0; i < 1000; ++i)
+  {
+    for (auto& k : keys) k = static_cast<T>(dist(gen));
+    auto expected = order < 0 ? std::min_element(keys, keys + n)
+                              : std::max_element(keys, keys + n);
+    REQUIRE(kernel::index(keys) == std::size_t(expected - keys));
+  }
+}
+
+template <typename T, std::size_t n>
+void check_simd_best_of()
+{
+  check_simd_best_of<T, n, -1>();
+  check_simd_best_of<T, n, 1>();
+}
+
+TEST_CASE("vectorized child selection picks the first of the best",
+          "[arity]")
+{
+  check_simd_best_of<std::int32_t, 8>();
+  check_simd_best_of<std::int32_t, 16>();
+  check_simd_best_of<std::int64_t, 8>();
+  check_simd_best_of<float, 8>();
+  check_simd_best_of<float, 16>();
+  check_simd_best_of<double, 8>();
+}
+
+TEST_CASE("a segmented vector never moves its elements", "[segmented]")
+{
+  rollbear::prio_q_internal::segmented_skip_vector<int, 4, 8> v;
+  REQUIRE(v.capacity() == 0);
+  REQUIRE(v.push_back(1) == 1);
+  REQUIRE(v.push_back(2) == 2);
+  REQUIRE(v.push_back(3) == 3);
+  REQUIRE(v.push_back(5) == 5);
+  REQUIRE(v.capacity() == 8);
+  int *first = &v[1];
+  for (int i = 0; i < 100; ++i) v.push_back(i);
+  REQUIRE(&v[1] == first);
+  REQUIRE(v[1] == 1);
+  REQUIRE(v.back() == 99);
+  REQUIRE(v.capacity() == (v.size() + 7) / 8 * 8);
+}
+
+TEST_CASE("a segmented vector grows and shrinks a segment at a time",
+          "[segmented]")
+{
+  rollbear::prio_q_internal::segmented_skip_vector<std::string, 4, 8> v;
+  v.reserve(20);
+  REQUIRE(v.capacity() == 24);
+  for (int i = 0; i < 12; ++i) v.push_back(std::to_string(i));
+  REQUIRE(v.size() == 16);
+  REQUIRE(v.back() == "11");
+  v.pop_back();
+  v.pop_back();
+  v.pop_back();
+  REQUIRE(v.size() == 12);
+  REQUIRE(v.back() == "8");
+  v.pop_back();
+  REQUIRE(v.size() == 11);
+  REQUIRE(v.back() == "7");
+  v.shrink_to_fit();
+  REQUIRE(v.capacity() == 16);
+  v.clear();
+  REQUIRE(v.empty());
+  REQUIRE(v.capacity() == 16);
+  v.shrink_to_fit();
+  REQUIRE(v.capacity() == 0);
+}
+
+TEST_CASE("queues in segmented storage order like contiguous ones",
+          "[segmented]")
+{
+  check_random_operations_match_reference<8, 2, rollbear::segmented_storage<8>>();
+  check_random_operations_match_reference<8, 2, rollbear::segmented_storage<64>>();
+  check_random_operations_match_reference<16, 4, rollbear::segmented_storage<32>>();
+  check_random_operations_match_reference<64, 8, rollbear::segmented_storage<4096>>();
+}
+
+TEST_CASE("reserve and shrink_to_fit work with segmented storage",
+          "[segmented]")
+{
+  prio_queue<16, int, std::string, std::less<int>, std::allocator<int>, 2,
+             rollbear::segmented_storage<64>> q;
+  q.reserve(100);
+  auto const capacity = q.capacity();
+  REQUIRE(capacity >= 100);
+  for (int i = 0; i < 100; ++i) q.push(100 - i, std::to_string(100 - i));
+  REQUIRE(q.capacity() == capacity);
+  for (int i = 0; i < 90; ++i) q.pop();
+  q.shrink_to_fit();
+  REQUIRE(q.capacity() < capacity);
+  REQUIRE(q.capacity() >= q.size());
+  for (int i = 91; i <= 100; ++i)
+  {
+    REQUIRE(q.top().first == i);
+    REQUIRE(q.top().second == std::to_string(i));
+    q.pop();
+  }
+}
+
+TEST_CASE("an interleaved vector keeps the payloads of a group after its keys",
+          "[interleaved]")
+{
+  rollbear::prio_q_internal::interleaved_skip_vector<int, int, 4, 4> v;
+  auto values = v.values();
+  values.push_back(-1);
+  REQUIRE(v.push_back(1) == 1);
+  REQUIRE(v.push_back(2) == 2);
+  values.push_back(-2);
+  for (int i = 3; i < 10; ++i)
+  {
+    v.push_back(i);
+    values.push_back(-i);
+  }
+  REQUIRE(v.size() == 12);
+  REQUIRE(v[5] == 4);
+  REQUIRE(values.get(5) == -4);
+  REQUIRE(v.back() == 9);
+  REQUIRE(values.back() == -9);
+  auto const base = reinterpret_cast<char*>(&v[1]) - sizeof(int);
+  REQUIRE(reinterpret_cast<char*>(&values.get(1)) - base == 4 * sizeof(int) + sizeof(int));
+  REQUIRE(reinterpret_cast<char*>(&v[5]) - base == 8 * sizeof(int) + sizeof(int));
+  v.pop_back();
+  REQUIRE(v.back() == 8);
+  REQUIRE(values.back() == -9);
+  values.pop_back();
+  REQUIRE(values.back() == -8);
+}
+
+TEST_CASE("queues in interleaved storage order like contiguous ones",
+          "[interleaved]")
+{
+  check_random_operations_match_reference<8, 2, rollbear::block_interleaved_storage>();
+  check_random_operations_match_reference<16, 4, rollbear::block_interleaved_storage>();
+  check_random_operations_match_reference<64, 8, rollbear::block_interleaved_storage>();
+  check_random_operations_match_reference<8, 2, rollbear::line_interleaved_storage<>>();
+  check_random_operations_match_reference<16, 4, rollbear::line_interleaved_storage<>>();
+  check_random_operations_match_reference<64, 8, rollbear::line_interleaved_storage<>>();
+  check_random_operations_match_reference<64, 16, rollbear::line_interleaved_storage<16>>();
+}
+
+TEST_CASE("interleaved storage handles non trivial payloads", "[interleaved]")
+{
+  prio_queue<16, int, std::string, std::less<int>, std::allocator<int>, 2,
+             rollbear::line_interleaved_storage<>> q;
+  q.reserve(100);
+  auto const capacity = q.capacity();
+  REQUIRE(capacity >= 100);
+  for (int i = 0; i < 100; ++i) q.push(100 - i, std::string(30, char('a' + i % 26)));
+  REQUIRE(q.capacity() == capacity);
+  for (int i = 0; i < 1000; ++i) q.emplace(1000 + i, std::size_t(30), 'z');
+  for (int i = 0; i < 1050; ++i) q.pop();
+  q.shrink_to_fit();
+  REQUIRE(q.capacity() < 1100);
+  REQUIRE(q.capacity() >= q.size());
+  for (int i = 0; i < 50; ++i)
+  {
+    REQUIRE(q.top().first == 1950 + i);
+    REQUIRE(q.pop_value().second == std::string(30, 'z'));
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("an mmap vector grows in whole mappings and keeps its contents",
+          "[mmap]")
+{
+  using vector = rollbear::prio_q_internal::mmap_skip_vector<int, 4>;
+  constexpr auto per_mapping = vector::mapping_granularity / sizeof(int);
+  vector v;
+  REQUIRE(v.capacity() == 0);
+  REQUIRE(v.push_back(1) == 1);
+  REQUIRE(v.capacity() == per_mapping);
+  std::size_t idx = 1;
+  for (int i = 2; v.size() < per_mapping * 3; ++i)
+  {
+    idx = v.push_back(i);
+  }
+  REQUIRE(v.capacity() == per_mapping * 4);
+  int expected = 0;
+  for (std::size_t i = 1; i <= idx; ++i)
+  {
+    if (i & 3) REQUIRE(v[i] == ++expected);
+  }
+  while (v.size() > 3) v.pop_back();
+  REQUIRE(v.back() == 2);
+  v.shrink_to_fit();
+  REQUIRE(v.capacity() == per_mapping);
+  REQUIRE(v[1] == 1);
+  v.clear();
+  v.shrink_to_fit();
+  REQUIRE(v.capacity() == 0);
+}
+
+TEST_CASE("queues in mmap storage order like contiguous ones", "[mmap]")
+{
+  check_random_operations_match_reference<8, 2, rollbear::mmap_storage>();
+  check_random_operations_match_reference<64, 8, rollbear::mmap_storage>();
+}
+
+TEST_CASE("mmap storage keeps non trivial payloads in a skip_vector", "[mmap]")
+{
+  using queue = prio_queue<16, int, std::string, std::less<int>,
+                           std::allocator<int>, 2, rollbear::mmap_storage>;
+  queue q;
+  q.reserve(100);
+  for (int i = 0; i < 100; ++i) q.push(100 - i, std::to_string(100 - i));
+  for (int i = 1; i <= 100; ++i)
+  {
+    REQUIRE(q.top().first == i);
+    REQUIRE(q.top().second == std::to_string(i));
+    q.pop();
+  }
+}
+
+TEST_CASE("a queue in mmap storage stays ordered when the mapping moves",
+          "[mmap]")
+{
+  prio_queue<16, int, int, std::less<int>, std::allocator<int>, 2,
+             rollbear::mmap_storage> q;
+  std::mt19937 gen(11);
+  for (int i = 0; i < 1500000; ++i)
+  {
+    auto k = static_cast<int>(gen() >> 1);
+    q.push(k, -k);
+  }
+  REQUIRE(q.size() == 1500000);
+  int last = q.top().first;
+  while (!q.empty())
+  {
+    REQUIRE(q.top().first >= last);
+    REQUIRE(q.top().second == -q.top().first);
+    last = q.top().first;
+    q.pop();
+  }
+}
+
+TEST_CASE("a radix queue pops in order like a prio_queue with monotone keys",
+          "[radix]")
+{
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> dist(0, 1000);
+  rollbear::radix_prio_queue<int, int> q;
+  std::multimap<int, int> reference;
+  int last = -100000;
+  for (int i = 0; i < 50000; ++i)
+  {
+    auto const op = gen() % 8;
+    if (op < 4 || reference.empty())
+    {
+      auto k = last + dist(gen);
+      q.push(k, -k);
+      reference.emplace(k, -k);
+    }
+    else if (op < 7)
+    {
+      REQUIRE(q.top().first == reference.begin()->first);
+      REQUIRE(q.top().second == -q.top().first);
+      last = q.top().first;
+      q.pop();
+      reference.erase(reference.begin());
+    }
+    else
+    {
+      REQUIRE(q.top().first == reference.begin()->first);
+      last = q.top().first;
+      auto k = last + dist(gen);
+      q.top().second = -k;
+      q.reschedule_top(k);
+      reference.erase(reference.begin());
+      reference.emplace(k, -k);
+    }
+    REQUIRE(q.size() == reference.size());
+  }
+  for (auto &e : reference)
+  {
+    REQUIRE(q.top().first == e.first);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("a radix queue without payload orders unsigned keys of all widths",
+          "[radix]")
+{
+  rollbear::radix_prio_queue<std::uint64_t, void> q;
+  std::uint64_t const keys[] = { ~std::uint64_t{}, 1, 0, 1ULL << 63, 3, 2,
+                                 1ULL << 32, 0 };
+  for (auto k : keys) q.push(k);
+  REQUIRE(q.size() == 8);
+  std::vector<std::uint64_t> sorted(std::begin(keys), std::end(keys));
+  std::sort(sorted.begin(), sorted.end());
+  for (auto k : sorted)
+  {
+    auto const &cq = q;
+    REQUIRE(cq.top() == k);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("a radix queue pops the element shown by top() among equal keys",
+          "[radix]")
+{
+  rollbear::radix_prio_queue<int, std::string> q;
+  q.push(5, "a");
+  q.push(3, "b");
+  q.push(5, "c");
+  q.push(3, "d");
+  q.push(4, "e");
+  std::multiset<std::string> seen;
+  seen.insert(q.top().second);
+  q.pop();
+  q.push(3, "f");
+  q.push(3, "g");
+  while (!q.empty())
+  {
+    seen.insert(q.top().second);
+    q.pop();
+  }
+  REQUIRE(seen == (std::multiset<std::string>{ "a", "b", "c", "d", "e", "f",
+                                               "g" }));
+}
+
+template <typename Q>
+void check_timers_match_reference(int max_delay)
+{
+  std::mt19937 gen(static_cast<unsigned>(max_delay));
+  std::uniform_int_distribution<int> near(0, 100);
+  std::uniform_int_distribution<int> far(0, max_delay);
+  long now = -1000000;
+  Q q(now);
+  std::multimap<long, long> reference;
+  auto delay = [&]() { return gen() % 4 ? near(gen) : far(gen); };
+  for (int i = 0; i < 50000; ++i)
+  {
+    auto const op = gen() % 8;
+    if (op < 4 || reference.empty())
+    {
+      auto k = now + delay();
+      q.push(k, -k);
+      reference.emplace(k, -k);
+    }
+    else if (op < 7)
+    {
+      REQUIRE(q.top().first == reference.begin()->first);
+      REQUIRE(q.top().second == -q.top().first);
+      now = q.top().first;
+      q.pop();
+      reference.erase(reference.begin());
+    }
+    else
+    {
+      REQUIRE(q.top().first == reference.begin()->first);
+      now = q.top().first;
+      auto k = now + delay();
+      q.top().second = -k;
+      q.reschedule_top(k);
+      reference.erase(reference.begin());
+      reference.emplace(k, -k);
+    }
+    REQUIRE(q.size() == reference.size());
+  }
+  for (auto &e : reference)
+  {
+    REQUIRE(q.top().first == e.first);
+    REQUIRE(q.top().second == e.second);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("a timer queue pops in deadline order within and beyond the horizon",
+          "[timer]")
+{
+  check_timers_match_reference<rollbear::timer_queue<long, long, 1>>(1000);
+  check_timers_match_reference<rollbear::timer_queue<long, long, 2>>(100000);
+  check_timers_match_reference<rollbear::timer_queue<long, long>>(100000);
+  check_timers_match_reference<rollbear::timer_queue<long, long>>(100000000);
+}
+
+TEST_CASE("a timer queue keeps near deadlines in the wheel and far in the heap",
+          "[timer]")
+{
+  rollbear::timer_queue<std::uint32_t, void, 2> q;
+  q.push(10U);
+  q.push(4000U);
+  q.push(5000U);
+  q.push(1U << 20);
+  REQUIRE(q.size() == 4);
+  REQUIRE(q.wheel_size() == 2);
+  REQUIRE(q.top() == 10U);
+  q.pop();
+  REQUIRE(q.top() == 4000U);
+  q.pop();
+  REQUIRE(q.wheel_size() == 0);
+  REQUIRE(q.top() == 5000U);
+  q.pop();
+  REQUIRE(q.top() == 1U << 20);
+  q.push((1U << 20) + 1);
+  REQUIRE(q.wheel_size() == 0);
+  q.pop();
+  REQUIRE(q.wheel_size() == 1);
+  REQUIRE(q.top() == (1U << 20) + 1);
+  q.pop();
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("a timer queue pops the element shown by top() among equal deadlines",
+          "[timer]")
+{
+  rollbear::timer_queue<int, std::string, 1> q;
+  q.push(5, "a");
+  q.push(300, "b");
+  q.push(5, "c");
+  q.push(300, "d");
+  q.push(70, "e");
+  std::multiset<std::string> seen;
+  seen.insert(q.top().second);
+  q.pop();
+  q.push(5, "f");
+  q.push(300, "g");
+  while (!q.empty())
+  {
+    seen.insert(q.top().second);
+    q.pop();
+  }
+  REQUIRE(seen == (std::multiset<std::string>{ "a", "b", "c", "d", "e", "f",
+                                               "g" }));
+}
+
+namespace {
+// Counts the bytes allocated from it, so that tests can see where a queue
+// takes its memory from.
+template <typename T>
+struct arena_allocator
+{
+  using value_type = T;
+  explicit arena_allocator(std::size_t *bytes_) noexcept : bytes(bytes_) {}
+  template <typename U>
+  arena_allocator(arena_allocator<U> const &a) noexcept : bytes(a.bytes) {}
+  T *allocate(std::size_t n)
+  {
+    *bytes += n * sizeof(T);
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) noexcept
+  {
+    *bytes -= n * sizeof(T);
+    std::allocator<T>{}.deallocate(p, n);
+  }
+  std::size_t *bytes;
+};
+
+template <typename T, typename U>
+bool operator==(arena_allocator<T> const &l, arena_allocator<U> const &r)
+{
+  return l.bytes == r.bytes;
+}
+
+template <typename T, typename U>
+bool operator!=(arena_allocator<T> const &l, arena_allocator<U> const &r)
+{
+  return !(l == r);
+}
+
+template <typename Storage>
+void check_allocator_is_used_for_keys_and_payloads()
+{
+  using Q = prio_queue<16, int, std::string, std::less<int>,
+                       arena_allocator<int>, 2, Storage>;
+  std::size_t bytes = 0;
+  {
+    Q q{arena_allocator<int>(&bytes)};
+    for (int i = 0; i < 1000; ++i)
+    {
+      q.push(1000 - i, std::to_string(i));
+    }
+    REQUIRE(bytes >= 1000 * (sizeof(int) + sizeof(std::string)));
+
+    Q moved(std::move(q));
+    REQUIRE(q.empty());
+    for (int i = 1; i <= 1000; ++i)
+    {
+      REQUIRE(moved.top().first == i);
+      REQUIRE(moved.top().second == std::to_string(1000 - i));
+      moved.pop();
+    }
+  }
+  REQUIRE(bytes == 0);
+}
+}
+
+TEST_CASE("keys and payloads are allocated from the queue's allocator",
+          "[allocator]")
+{
+  check_allocator_is_used_for_keys_and_payloads<rollbear::contiguous_storage>();
+  check_allocator_is_used_for_keys_and_payloads<rollbear::segmented_storage<64>>();
+  check_allocator_is_used_for_keys_and_payloads<rollbear::block_interleaved_storage>();
+}
+
+TEST_CASE("an addressable queue allocates its payloads from its allocator",
+          "[allocator]")
+{
+  auto bytes_for = [](auto payload) {
+    using V = decltype(payload);
+    std::size_t bytes = 0;
+    std::size_t used = 0;
+    {
+      rollbear::addressable_prio_queue<8, int, V, std::less<int>, arena_allocator<int>>
+        q{std::less<int>{}, arena_allocator<int>(&bytes)};
+      for (int i = 0; i < 1000; ++i) q.push(i, V{});
+      used = bytes;
+    }
+    REQUIRE(bytes == 0);
+    return used;
+  };
+  struct big { char c[64]; };
+  REQUIRE(bytes_for(big{}) >= bytes_for(0) + 1000 * sizeof(big));
+}
+
+namespace {
+template <typename Storage>
+void check_move_assignment_between_arenas()
+{
+  using Q = prio_queue<16, int, std::unique_ptr<int>, std::less<int>,
+                       arena_allocator<int>, 2, Storage>;
+  std::size_t from_bytes = 0;
+  std::size_t to_bytes = 0;
+  {
+    Q from{arena_allocator<int>(&from_bytes)};
+    Q to{arena_allocator<int>(&to_bytes)};
+    for (int i = 0; i < 500; ++i)
+    {
+      from.push(i, std::make_unique<int>(i));
+    }
+    to.push(-1, std::make_unique<int>(-1));
+    to = std::move(from);
+    REQUIRE(from.empty());
+    from.shrink_to_fit();
+    REQUIRE(from_bytes == 0);
+    REQUIRE(to_bytes >= 500 * (sizeof(int) + sizeof(std::unique_ptr<int>)));
+    for (int i = 0; i < 500; ++i)
+    {
+      REQUIRE(to.top().first == i);
+      REQUIRE(*to.top().second == i);
+      to.pop();
+    }
+    REQUIRE(to.empty());
+  }
+  REQUIRE(from_bytes == 0);
+  REQUIRE(to_bytes == 0);
+}
+}
+
+TEST_CASE("move assignment between unequal allocators moves the elements",
+          "[allocator]")
+{
+  check_move_assignment_between_arenas<rollbear::contiguous_storage>();
+  check_move_assignment_between_arenas<rollbear::segmented_storage<64>>();
+  check_move_assignment_between_arenas<rollbear::block_interleaved_storage>();
+}
+
+#ifdef ROLLBEAR_PRIO_QUEUE_PMR
+TEST_CASE("a pmr queue takes keys, payloads and their memory from its resource",
+          "[allocator]")
+{
+  alignas(std::max_align_t) static char buffer[256 * 1024];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+                                            std::pmr::null_memory_resource());
+  rollbear::pmr::prio_queue<16, int, std::pmr::string> q(&arena);
+  for (int i = 0; i < 1000; ++i)
+  {
+    q.emplace(1000 - i, std::size_t(40), char('a' + i % 26));
+  }
+  REQUIRE(q.top().second.get_allocator().resource() == &arena);
+  for (int i = 1; i <= 1000; ++i)
+  {
+    REQUIRE(q.top().first == i);
+    REQUIRE(q.top().second.size() == 40);
+    REQUIRE(q.top().second[0] == char('a' + (1000 - i) % 26));
+    q.pop();
+  }
+}
+#endif
+
+TEST_CASE("an indirect queue pops the same as a multimap", "[indirect]")
+{
+  rollbear::indirect_prio_queue<16, int, std::string> q;
+  std::multimap<int, std::string> ref;
+  std::mt19937 gen(18);
+  for (int i = 0; i < 20000; ++i)
+  {
+    auto const op = gen() % 8;
+    if (op < 4 || ref.empty())
+    {
+      int k = int(gen() % 1000);
+      q.push(k, std::to_string(k));
+      ref.emplace(k, std::to_string(k));
+    }
+    else if (op == 4)
+    {
+      int k = int(gen() % 1000);
+      q.replace_top(k, std::to_string(k));
+      ref.erase(ref.begin());
+      ref.emplace(k, std::to_string(k));
+    }
+    else if (op == 5)
+    {
+      auto top = q.pop_value();
+      REQUIRE(top.first == ref.begin()->first);
+      REQUIRE(top.second == std::to_string(top.first));
+      ref.erase(ref.begin());
+    }
+    else
+    {
+      REQUIRE(q.top().first == ref.begin()->first);
+      REQUIRE(q.top().second == std::to_string(q.top().first));
+      q.pop();
+      ref.erase(ref.begin());
+    }
+    REQUIRE(q.size() == ref.size());
+  }
+  while (!ref.empty())
+  {
+    REQUIRE(q.top().first == ref.begin()->first);
+    q.pop();
+    ref.erase(ref.begin());
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("an indirect queue never moves its payloads", "[indirect]")
+{
+  rollbear::indirect_prio_queue<16, int, move_counted> q;
+  std::vector<move_counted const*> addresses(1000);
+  move_counted::moves = 0;
+  for (int k = 999; k >= 0; --k)
+  {
+    q.emplace(k, k, std::to_string(k));
+    REQUIRE(q.top().first == k);
+    addresses[std::size_t(k)] = &q.top().second;
+  }
+  REQUIRE(move_counted::moves == 0);
+  q.reschedule_top(2000);
+  for (int k = 1; k < 1000; ++k)
+  {
+    REQUIRE(q.top().first == k);
+    REQUIRE(&q.top().second == addresses[std::size_t(k)]);
+    q.pop();
+  }
+  REQUIRE(q.top().first == 2000);
+  REQUIRE(&q.top().second == addresses[0]);
+  REQUIRE(move_counted::moves == 0);
+}
+
+TEST_CASE("an indirect queue destroys its payloads and reuses their slots",
+          "[indirect]")
+{
+  auto p = std::make_shared<int>(3);
+  {
+    rollbear::indirect_prio_queue<8, int, std::shared_ptr<int>> q;
+    for (int i = 0; i < 600; ++i) q.push(i, p);
+    REQUIRE(p.use_count() == 601);
+    for (int i = 0; i < 300; ++i) q.pop();
+    REQUIRE(p.use_count() == 301);
+    auto const top = &q.top().second;
+    q.pop();
+    q.push(-1, p);
+    REQUIRE(&q.top().second == top);
+    q.replace_top(-2, std::make_shared<int>(4));
+    REQUIRE(p.use_count() == 300);
+    REQUIRE(*q.top().second == 4);
+    q.clear();
+    REQUIRE(p.use_count() == 1);
+    for (int i = 0; i < 100; ++i) q.push(i, p);
+    for (int i = 0; i < 50; ++i) q.pop();
+  }
+  REQUIRE(p.use_count() == 1);
+}
+
+namespace {
+template <typename Q>
+std::vector<int> pop_keys(Q &q)
+{
+  std::vector<int> keys;
+  while (!q.empty())
+  {
+    REQUIRE(q.top().second == std::to_string(q.top().first));
+    keys.push_back(q.top().first);
+    q.pop();
+  }
+  return keys;
+}
+
+template <typename Storage>
+void check_merge(std::size_t to_size, std::size_t from_size)
+{
+  using Q = prio_queue<16, int, std::string, std::less<int>,
+                       std::allocator<int>, 2, Storage>;
+  Q to;
+  Q from;
+  std::vector<int> expected;
+  std::mt19937 gen(20);
+  for (std::size_t i = 0; i != to_size + from_size; ++i)
+  {
+    int k = int(gen() % 10000);
+    (i < to_size ? to : from).push(k, std::to_string(k));
+    expected.push_back(k);
+  }
+  to.merge(std::move(from));
+  REQUIRE(from.empty());
+  REQUIRE(to.size() == expected.size());
+  std::sort(expected.begin(), expected.end());
+  REQUIRE(pop_keys(to) == expected);
+}
+
+template <typename Storage>
+void check_split(std::size_t size, int threshold)
+{
+  using Q = prio_queue<16, int, std::string, std::less<int>,
+                       std::allocator<int>, 2, Storage>;
+  Q q;
+  std::vector<int> below;
+  std::vector<int> above;
+  std::mt19937 gen(20);
+  for (std::size_t i = 0; i != size; ++i)
+  {
+    int k = int(gen() % 10000);
+    q.push(k, std::to_string(k));
+    (k < threshold ? below : above).push_back(k);
+  }
+  auto rest = q.split(threshold);
+  std::sort(below.begin(), below.end());
+  std::sort(above.begin(), above.end());
+  REQUIRE(q.size() == below.size());
+  REQUIRE(rest.size() == above.size());
+  REQUIRE(pop_keys(q) == below);
+  REQUIRE(pop_keys(rest) == above);
+}
+
+template <typename Storage>
+void check_split_half(std::size_t size)
+{
+  using Q = prio_queue<16, int, std::string, std::less<int>,
+                       std::allocator<int>, 2, Storage>;
+  Q q;
+  std::vector<int> expected;
+  std::mt19937 gen(20);
+  for (std::size_t i = 0; i != size; ++i)
+  {
+    int k = int(gen() % 10000);
+    q.push(k, std::to_string(k));
+    expected.push_back(k);
+  }
+  std::sort(expected.begin(), expected.end());
+  auto half = q.split_half();
+  REQUIRE(half.size() == size / 2);
+  REQUIRE(q.size() == size - size / 2);
+  if (size) REQUIRE(q.top().first == expected.front());
+  auto keys = pop_keys(q);
+  REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+  auto half_keys = pop_keys(half);
+  REQUIRE(std::is_sorted(half_keys.begin(), half_keys.end()));
+  keys.insert(keys.end(), half_keys.begin(), half_keys.end());
+  std::sort(keys.begin(), keys.end());
+  REQUIRE(keys == expected);
+}
+
+template <typename Storage>
+void check_merge_and_split()
+{
+  for (std::size_t size : { 0, 1, 2, 15, 16, 17, 1000 })
+  {
+    for (std::size_t other : { 0, 1, 10, 1000 })
+    {
+      check_merge<Storage>(size, other);
+    }
+    for (int threshold : { 0, 10, 5000, 10000 })
+    {
+      check_split<Storage>(size, threshold);
+    }
+    check_split_half<Storage>(size);
+  }
+}
+}
+
+TEST_CASE("merge, split and split_half keep both queues heaps", "[merge]")
+{
+  check_merge_and_split<rollbear::contiguous_storage>();
+  check_merge_and_split<rollbear::segmented_storage<64>>();
+  check_merge_and_split<rollbear::block_interleaved_storage>();
+  check_merge_and_split<rollbear::line_interleaved_storage<>>();
+}
+
+TEST_CASE("a queue without payloads can be merged and split", "[merge]")
+{
+  prio_queue<8, int, void> q;
+  prio_queue<8, int, void> other;
+  for (int i = 0; i < 100; ++i) q.push(i * 2);
+  for (int i = 0; i < 30; ++i) other.push(i * 2 + 1);
+  q.merge(std::move(other));
+  REQUIRE(q.size() == 130);
+  auto rest = q.split(40);
+  REQUIRE(q.size() == 40);
+  REQUIRE(rest.top() == 40);
+  auto half = rest.split_half();
+  REQUIRE(rest.top() == 40);
+  REQUIRE(rest.size() + half.size() == 90);
+  for (int i = 0; i < 40; ++i)
+  {
+    REQUIRE(q.top() == i);
+    q.pop();
+  }
+}
+
+TEST_CASE("split queues take their memory from the same allocator", "[merge]")
+{
+  std::size_t bytes = 0;
+  {
+    using Q = prio_queue<16, int, std::unique_ptr<int>, std::less<int>,
+                         arena_allocator<int>>;
+    Q q{arena_allocator<int>(&bytes)};
+    for (int i = 0; i < 1000; ++i) q.push(i, std::make_unique<int>(i));
+    auto rest = q.split(500);
+    auto half = rest.split_half();
+    REQUIRE(q.size() == 500);
+    REQUIRE(rest.size() + half.size() == 500);
+    q.merge(std::move(half));
+    REQUIRE(*q.top().second == 0);
+  }
+  REQUIRE(bytes == 0);
+}
+
+namespace {
+template <typename Q>
+void require_descending(Q &q, std::size_t size)
+{
+  REQUIRE(q.size() == size);
+  int last = std::numeric_limits<int>::max();
+  while (!q.empty())
+  {
+    REQUIRE(q.top().first <= last);
+    REQUIRE(q.top().second == -q.top().first);
+    last = q.top().first;
+    q.pop();
+  }
+}
+
+template <typename Storage>
+void check_split_with_stateful_comparator()
+{
+  using compare = std::function<bool(int, int)>;
+  using Q = prio_queue<16, int, int, compare, std::allocator<int>, 2, Storage>;
+  Q q(compare([](int l, int r) { return l > r; }));
+  for (int i = 0; i < 1000; ++i) q.push((i * 7919) % 1000, -((i * 7919) % 1000));
+  auto rest = q.split(500);
+  REQUIRE(q.top().first == 999);
+  REQUIRE(rest.top().first == 500);
+  auto half = rest.split_half();
+  require_descending(half, 250);
+  require_descending(rest, 251);
+  require_descending(q, 499);
+}
+}
+
+TEST_CASE("split queues order by the comparator of the queue split", "[merge]")
+{
+  check_split_with_stateful_comparator<rollbear::contiguous_storage>();
+  check_split_with_stateful_comparator<rollbear::segmented_storage<64>>();
+  check_split_with_stateful_comparator<rollbear::block_interleaved_storage>();
+  check_split_with_stateful_comparator<rollbear::mmap_storage>();
+}
+
+namespace {
+// Throws from its move constructor once, when moves_left reaches 0.
+int moves_left = -1;
+
+struct throwing_move
+{
+  throwing_move(int v) : value(v) { }
+  throwing_move(throwing_move const &other) : value(other.value) { }
+  throwing_move(throwing_move &&other) : value(other.value)
+  {
+    if (moves_left == 0)
+    {
+      moves_left = -1;
+      throw std::runtime_error("move");
+    }
+    if (moves_left > 0) --moves_left;
+  }
+  throwing_move &operator=(throwing_move const &) = default;
+  throwing_move &operator=(throwing_move &&) noexcept = default;
+  int value;
+};
+
+template <typename Q>
+std::vector<int> drain_keys(Q &q)
+{
+  std::vector<int> keys;
+  while (!q.empty())
+  {
+    REQUIRE(q.top().second.value == -q.top().first);
+    REQUIRE((keys.empty() || keys.back() <= q.top().first));
+    keys.push_back(q.top().first);
+    q.pop();
+  }
+  return keys;
+}
+}
+
+TEST_CASE("a throwing move in merge or split_half keeps every element",
+          "[merge]")
+{
+  using Q = prio_queue<8, int, throwing_move>;
+  std::vector<int> expected;
+  Q q;
+  Q other;
+  for (int i = 0; i < 150; ++i)
+  {
+    int const k = (i * 7919) % 150;
+    (i < 50 ? q : other).push(k, throwing_move(-k));
+    expected.push_back(k);
+  }
+  std::sort(expected.begin(), expected.end());
+
+  moves_left = 30;
+  REQUIRE_THROWS_AS(q.merge(std::move(other)), std::runtime_error);
+  REQUIRE(q.size() + other.size() == 150);
+  REQUIRE(!other.empty());
+  auto keys = drain_keys(q);
+  auto rest = drain_keys(other);
+  keys.insert(keys.end(), rest.begin(), rest.end());
+  std::sort(keys.begin(), keys.end());
+  REQUIRE(keys == expected);
+
+  for (auto k : expected) q.push(k, throwing_move(-k));
+  moves_left = 30;
+  REQUIRE_THROWS_AS(q.split_half(), std::runtime_error);
+  REQUIRE(drain_keys(q) == expected);
+}
+
+namespace {
+template <typename Storage, typename V, typename F>
+void check_copies(F make_value)
+{
+  using Q = prio_queue<16, int, V, std::less<int>, std::allocator<int>, 2,
+                       Storage>;
+  Q q;
+  std::mt19937 gen(21);
+  for (int i = 0; i < 1000; ++i)
+  {
+    int k = int(gen() % 10000);
+    q.push(k, make_value(k));
+  }
+  for (int i = 0; i < 100; ++i) q.pop();
+
+  Q copy(q);
+  REQUIRE(copy.size() == q.size());
+  Q assigned;
+  for (int i = 0; i < 10; ++i) assigned.push(i, make_value(i));
+  assigned = q;
+  auto const &self = assigned;
+  assigned = self;
+  auto clone = q.clone();
+  REQUIRE(clone.capacity() == q.capacity());
+
+  // The copies are independent of the original.
+  copy.push(-1, make_value(-1));
+  REQUIRE(q.top().first != -1);
+
+  REQUIRE(copy.top().first == -1);
+  copy.pop();
+  while (!q.empty())
+  {
+    REQUIRE(copy.top().first == q.top().first);
+    REQUIRE(copy.top().second == q.top().second);
+    REQUIRE(assigned.top().first == q.top().first);
+    REQUIRE(assigned.top().second == q.top().second);
+    REQUIRE(clone.top().first == q.top().first);
+    REQUIRE(clone.top().second == q.top().second);
+    q.pop();
+    copy.pop();
+    assigned.pop();
+    clone.pop();
+  }
+  REQUIRE(copy.empty());
+  REQUIRE(assigned.empty());
+  REQUIRE(clone.empty());
+}
+
+template <typename Storage>
+void check_copies()
+{
+  check_copies<Storage, int>([](int k) { return k * 2; });
+  check_copies<Storage, std::string>([](int k) { return std::to_string(k); });
+}
+}
+
+TEST_CASE("copies pop the same as the original", "[copy]")
+{
+  check_copies<rollbear::contiguous_storage>();
+  check_copies<rollbear::segmented_storage<64>>();
+  check_copies<rollbear::block_interleaved_storage>();
+  check_copies<rollbear::line_interleaved_storage<>>();
+  check_copies<rollbear::mmap_storage, int>([](int k) { return k * 2; });
+}
+
+TEST_CASE("a queue without payloads can be copied", "[copy]")
+{
+  prio_queue<8, int, void> q;
+  for (int i = 0; i < 100; ++i) q.push((i * 37) % 100);
+  auto copy = q;
+  auto clone = q.clone();
+  for (int i = 0; i < 100; ++i)
+  {
+    REQUIRE(copy.top() == i);
+    REQUIRE(clone.top() == i);
+    copy.pop();
+    clone.pop();
+  }
+  REQUIRE(q.size() == 100);
+}
+
+TEST_CASE("copies take their memory from the same allocator", "[copy]")
+{
+  std::size_t bytes = 0;
+  {
+    using Q = prio_queue<16, int, std::string, std::less<int>,
+                         arena_allocator<int>>;
+    Q q{arena_allocator<int>(&bytes)};
+    for (int i = 0; i < 1000; ++i) q.push(i, std::to_string(i));
+    auto const before = bytes;
+    Q copy(q);
+    REQUIRE(bytes > before);
+    auto clone = copy.clone();
+    copy = clone;
+    REQUIRE(clone.top().second == "0");
+  }
+  REQUIRE(bytes == 0);
+}
+
+namespace {
+template <typename Storage>
+void check_snapshot()
+{
+  using Q = prio_queue<16, int, long, std::less<int>, std::allocator<int>, 2,
+                       Storage>;
+  Q q;
+  std::mt19937 gen(22);
+  for (int i = 0; i < 10000; ++i)
+  {
+    int k = int(gen() % 100000);
+    q.push(k, k * 3L);
+  }
+  for (int i = 0; i < 1000; ++i) q.pop();
+
+  std::stringstream snapshot;
+  q.save(snapshot);
+  Q loaded;
+  loaded.push(1, 2);
+  loaded.load(snapshot);
+  REQUIRE(loaded.size() == q.size());
+
+  // Every element is back in its slot, so the snapshots are identical.
+  std::stringstream again;
+  loaded.save(again);
+  REQUIRE(again.str() == snapshot.str());
+  while (!q.empty())
+  {
+    REQUIRE(loaded.top().first == q.top().first);
+    REQUIRE(loaded.top().second == q.top().second);
+    q.pop();
+    loaded.pop();
+  }
+  REQUIRE(loaded.empty());
+}
+}
+
+TEST_CASE("a loaded snapshot pops the same as the saved queue", "[snapshot]")
+{
+  check_snapshot<rollbear::contiguous_storage>();
+  check_snapshot<rollbear::segmented_storage<64>>();
+  check_snapshot<rollbear::block_interleaved_storage>();
+  check_snapshot<rollbear::mmap_storage>();
+}
+
+TEST_CASE("snapshots of queues without payloads and empty queues load",
+          "[snapshot]")
+{
+  prio_queue<8, int, void> q;
+  std::stringstream empty;
+  q.save(empty);
+  for (int i = 0; i < 100; ++i) q.push((i * 37) % 100);
+  std::stringstream full;
+  q.save(full);
+
+  prio_queue<8, int, void> loaded;
+  loaded.load(full);
+  for (int i = 0; i < 100; ++i)
+  {
+    REQUIRE(loaded.top() == i);
+    loaded.pop();
+  }
+  loaded.push(3);
+  loaded.load(empty);
+  REQUIRE(loaded.empty());
+}
+
+TEST_CASE("a snapshot from another block size or arity is rebuilt",
+          "[snapshot]")
+{
+  prio_queue<16, int, int> q;
+  std::mt19937 gen(4711);
+  std::vector<int> keys;
+  for (int i = 0; i < 5000; ++i)
+  {
+    keys.push_back(int(gen() % 1000000));
+    q.push(keys.back(), -keys.back());
+  }
+  std::sort(keys.begin(), keys.end());
+  std::stringstream snapshot;
+  q.save(snapshot);
+  auto const bytes = snapshot.str();
+
+  auto check = [&](auto loaded) {
+    std::istringstream is(bytes);
+    loaded.load(is);
+    REQUIRE(loaded.size() == keys.size());
+    for (auto k : keys)
+    {
+      REQUIRE(loaded.top().first == k);
+      REQUIRE(loaded.top().second == -k);
+      loaded.pop();
+    }
+  };
+  check(prio_queue<64, int, int>{});
+  check(prio_queue<8, int, int, std::less<int>, std::allocator<int>, 4>{});
+}
+
+TEST_CASE("a bad snapshot throws and leaves the queue empty", "[snapshot]")
+{
+  prio_queue<16, int, int> q;
+  for (int i = 0; i < 1000; ++i) q.push(i, i);
+  std::stringstream snapshot;
+  q.save(snapshot);
+  auto const bytes = snapshot.str();
+
+  auto load = [](std::string const &s) {
+    prio_queue<16, int, int> loaded;
+    loaded.push(1, 1);
+    std::istringstream is(s);
+    REQUIRE_THROWS_AS(loaded.load(is), std::runtime_error);
+    REQUIRE(loaded.empty());
+  };
+  load("");
+  load(bytes.substr(0, bytes.size() - 1));
+  auto corrupt = bytes;
+  corrupt[corrupt.size() / 2] ^= 1;
+  load(corrupt);
+  auto wrong = bytes;
+  wrong[0] ^= 1;
+  load(wrong);
+  // A count far past the elements there are must not be trusted with an
+  // allocation up front.
+  auto huge = bytes;
+  std::uint64_t const count = std::uint64_t{1} << 40;
+  std::memcpy(&huge[6 * sizeof(std::uint64_t)], &count, sizeof(count));
+  load(huge);
+  // The header is part of the checksum.
+  auto arity = bytes;
+  arity[3 * sizeof(std::uint64_t)] ^= 2;
+  load(arity);
+
+  prio_queue<16, int, long> other;
+  std::istringstream is(bytes);
+  REQUIRE_THROWS_AS(other.load(is), std::runtime_error);
+}
+
+namespace {
+// A directory of its own, that must be empty when removed.
+struct temp_dir
+{
+  temp_dir() { REQUIRE(::mkdtemp(&path[0]) != nullptr); }
+  ~temp_dir() { ::rmdir(path.c_str()); }
+  bool remove() { return ::rmdir(path.c_str()) == 0; }
+  std::string path = "/tmp/prio_queue_test.XXXXXX";
+};
+}
+
+TEST_CASE("an external queue pops in order past its memory budget",
+          "[external]")
+{
+  temp_dir dir;
+  {
+    // Room for 64 new elements, and blocks of 8 elements for 6 runs, so
+    // the runs are merged many times.
+    rollbear::external_prio_queue<16, int, int> q(dir.path, 1024, 64);
+    std::multimap<int, int> reference;
+    std::mt19937 gen(23);
+    std::size_t max_runs = 0;
+    for (int round = 0; round < 20; ++round)
+    {
+      for (int i = 0; i < 1000; ++i)
+      {
+        int k = int(gen() % 100000);
+        q.push(k, -k);
+        reference.emplace(k, -k);
+      }
+      max_runs = std::max(max_runs, q.runs());
+      for (int i = 0; i < 500; ++i)
+      {
+        REQUIRE(q.top().first == reference.begin()->first);
+        REQUIRE(q.top().second == -q.top().first);
+        q.pop();
+        reference.erase(reference.begin());
+      }
+      REQUIRE(q.size() == reference.size());
+    }
+    REQUIRE(max_runs > 1);
+    REQUIRE(max_runs <= 6);
+    while (!reference.empty())
+    {
+      REQUIRE(q.top().first == reference.begin()->first);
+      q.pop();
+      reference.erase(reference.begin());
+    }
+    REQUIRE(q.empty());
+    REQUIRE(q.runs() == 0);
+  }
+  REQUIRE(dir.remove());
+}
+
+TEST_CASE("an external queue merges only the smaller half of its runs",
+          "[external]")
+{
+  temp_dir dir;
+  {
+    // Room for 64 new elements and 6 runs, so the 7th run merges 3 of the
+    // 6 to one.
+    rollbear::external_prio_queue<16, int, int> q(dir.path, 1024, 64);
+    for (int i = 0; i < 64 * 7; ++i) q.push(i, -i);
+    REQUIRE(q.runs() == 6);
+    q.push(-1, 1);
+    REQUIRE(q.runs() == 5);
+    REQUIRE(q.size() == 64 * 7 + 1);
+    for (int i = -1; i < 64 * 7; ++i)
+    {
+      REQUIRE(q.top().first == i);
+      REQUIRE(q.top().second == -i);
+      q.pop();
+    }
+    REQUIRE(q.empty());
+  }
+  REQUIRE(dir.remove());
+}
+
+TEST_CASE("an external queue drops a run it fails to write", "[external]")
+{
+  temp_dir dir;
+  {
+    // Runs of 64 elements, 512 bytes, in blocks of 64 bytes.
+    rollbear::external_prio_queue<16, int, int> q(dir.path, 1024, 64);
+    for (int i = 0; i < 64 * 3; ++i) q.push(i, -i);
+    REQUIRE(q.runs() == 2);
+    // Files may not grow past 256 bytes, so the third run fails half way.
+    ::rlimit old_limit;
+    REQUIRE(::getrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+    auto const old_handler = std::signal(SIGXFSZ, SIG_IGN);
+    ::rlimit limit = old_limit;
+    limit.rlim_cur = 256;
+    REQUIRE(::setrlimit(RLIMIT_FSIZE, &limit) == 0);
+    bool threw = false;
+    try
+    {
+      q.push(-1, 1);
+    }
+    catch (std::runtime_error const &)
+    {
+      threw = true;
+    }
+    ::setrlimit(RLIMIT_FSIZE, &old_limit);
+    std::signal(SIGXFSZ, old_handler);
+    REQUIRE(threw);
+    REQUIRE(q.runs() == 2);
+    REQUIRE(q.size() < 64 * 3);
+
+    // What is left pops in order, and more runs can be written and merged.
+    for (int i = 0; i < 64 * 6; ++i) q.push(1000 + i, -(1000 + i));
+    REQUIRE(q.runs() == 6);
+    auto const size = q.size();
+    int last = std::numeric_limits<int>::min();
+    for (std::size_t i = 0; i != size; ++i)
+    {
+      REQUIRE(q.top().first >= last);
+      REQUIRE(q.top().second == -q.top().first);
+      last = q.top().first;
+      q.pop();
+    }
+    REQUIRE(q.empty());
+  }
+  REQUIRE(dir.remove());
+}
+
+TEST_CASE("an external queue without payloads removes its files",
+          "[external]")
+{
+  temp_dir dir;
+  {
+    rollbear::external_prio_queue<8, unsigned, void, std::greater<>> q(dir.path, 4096, 256);
+    for (unsigned i = 0; i < 10000; ++i) q.push((i * 7919) % 10000);
+    REQUIRE(q.runs() > 1);
+    for (unsigned i = 10000; i-- > 9000;)
+    {
+      REQUIRE(q.top() == i);
+      q.pop();
+    }
+    q.clear();
+    REQUIRE(q.empty());
+    REQUIRE(dir.remove());
+    // The next run has no directory to go to.
+    REQUIRE_THROWS_AS([&] { for (unsigned i = 0; i < 10000; ++i) q.push(i); }(),
+                      std::runtime_error);
+  }
+}
+
+namespace {
+template <typename Q>
+void check_ordered()
+{
+  Q q;
+  std::mt19937 gen(24);
+  for (int i = 0; i < 5000; ++i)
+  {
+    int k = int(gen() % 1000);
+    q.push(k, k + 1);
+  }
+  for (int i = 0; i < 500; ++i) q.pop();
+  auto copy = q;
+  std::vector<std::pair<int, int>> expected;
+  copy.drain(std::back_inserter(expected));
+
+  for (std::size_t k : { 0U, 1U, 32U, 1000U, 10000U })
+  {
+    std::vector<std::pair<int, int>> top;
+    q.peek_top_k(k, std::back_inserter(top));
+    REQUIRE(top.size() == std::min<std::size_t>(k, expected.size()));
+    for (std::size_t i = 0; i != top.size(); ++i)
+    {
+      REQUIRE(top[i].first == expected[i].first);
+      REQUIRE(top[i].second == top[i].first + 1);
+    }
+  }
+  std::size_t i = 0;
+  for (auto e : q.ordered())
+  {
+    REQUIRE(e.first == expected[i].first);
+    REQUIRE(e.second == e.first + 1);
+    ++i;
+  }
+  REQUIRE(i == expected.size());
+
+  // The queue is left as it was.
+  for (auto const &e : expected)
+  {
+    REQUIRE(q.top().first == e.first);
+    q.pop();
+  }
+}
+}
+
+TEST_CASE("peek_top_k and ordered() walk the queue in order", "[peek]")
+{
+  check_ordered<prio_queue<16, int, int>>();
+  check_ordered<prio_queue<8, int, int, std::less<int>, std::allocator<int>, 4>>();
+  check_ordered<prio_queue<16, int, int, std::less<int>, std::allocator<int>, 2,
+                           rollbear::segmented_storage<64>>>();
+  check_ordered<prio_queue<16, int, int, std::less<int>, std::allocator<int>, 2,
+                           rollbear::block_interleaved_storage>>();
+}
+
+TEST_CASE("ordered iterators of a queue without payloads", "[peek]")
+{
+  prio_queue<8, int, void, std::greater<int>> q;
+  auto const view = q.ordered();
+  REQUIRE(view.begin() == view.end());
+  for (int i = 0; i < 100; ++i) q.push((i * 37) % 100);
+  auto i = q.ordered().begin();
+  REQUIRE(*i++ == 99);
+  REQUIRE(*i == 98);
+  REQUIRE(i != q.ordered().end());
+  std::vector<int> top;
+  q.peek_top_k(3, std::back_inserter(top));
+  REQUIRE(top == (std::vector<int>{ 99, 98, 97 }));
+  REQUIRE(q.size() == 100);
+}
+
+namespace {
+template <typename Q>
+void check_erase_transform()
+{
+  Q q;
+  std::multiset<std::pair<int, int>> reference;
+  std::mt19937 gen(25);
+  for (int i = 0; i < 5000; ++i)
+  {
+    int k = int(gen() % 10000);
+    q.push(k, i % 7);
+    reference.emplace(k, i % 7);
+  }
+  for (int i = 0; i < 300; ++i)
+  {
+    reference.erase(reference.find(std::make_pair(q.top().first, q.top().second)));
+    q.pop();
+  }
+
+  // Every element once, in some order.
+  std::multiset<std::pair<int, int>> visited;
+  for (auto e : q) visited.emplace(e.first, e.second);
+  REQUIRE(visited == reference);
+  REQUIRE(std::size_t(std::distance(q.begin(), q.end())) == q.size());
+
+  auto const removed = q.erase_if([](auto const &e) { return e.second == 3; });
+  std::size_t expected_removed = 0;
+  for (auto i = reference.begin(); i != reference.end();)
+  {
+    if (i->second == 3) { i = reference.erase(i); ++expected_removed; }
+    else ++i;
+  }
+  REQUIRE(removed == expected_removed);
+  REQUIRE(q.size() == reference.size());
+  REQUIRE(q.erase_if([](auto const &) { return false; }) == 0);
+
+  // A transform that reverses the order.
+  q.transform_keys([](int k) { return 20000 - k * 2; });
+  std::vector<std::pair<int, int>> expected;
+  for (auto &e : reference) expected.emplace_back(20000 - e.first * 2, e.second);
+  std::sort(expected.begin(), expected.end(),
+            [](auto const &l, auto const &r) { return l.first < r.first; });
+  for (auto &e : expected)
+  {
+    REQUIRE(q.top().first == e.first);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+  REQUIRE(q.begin() == q.end());
+}
+}
+
+TEST_CASE("iteration, erase_if and transform_keys keep the queue a heap",
+          "[erase]")
+{
+  check_erase_transform<prio_queue<16, int, int>>();
+  check_erase_transform<prio_queue<8, int, int, std::less<int>, std::allocator<int>, 4>>();
+  check_erase_transform<prio_queue<16, int, int, std::less<int>, std::allocator<int>, 2,
+                                   rollbear::segmented_storage<64>>>();
+  check_erase_transform<prio_queue<16, int, int, std::less<int>, std::allocator<int>, 2,
+                                   rollbear::line_interleaved_storage<>>>();
+}
+
+TEST_CASE("erase_if destroys the payloads it removes", "[erase]")
+{
+  prio_queue<8, int, std::unique_ptr<int>> q;
+  // Fill a whole number of blocks, so that the end is at a gap.
+  for (int i = 0; i < 7 * 4; ++i) q.push(i, std::make_unique<int>(i));
+  REQUIRE(std::size_t(std::distance(q.begin(), q.end())) == q.size());
+  REQUIRE(q.erase_if([](auto const &e) { return *e.second % 2 == 0; }) == 14);
+  for (int i = 1; i < 7 * 4; i += 2)
+  {
+    REQUIRE(*q.top().second == i);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("a throwing erase_if predicate keeps every element", "[erase]")
+{
+  prio_queue<16, int, std::unique_ptr<int>> q;
+  for (int i = 0; i < 40; ++i) q.push(i, std::make_unique<int>(i));
+  int calls = 0;
+  REQUIRE_THROWS_AS(q.erase_if([&](auto const &) -> bool {
+                      if (++calls == 20) throw std::runtime_error("stop");
+                      return calls % 2 == 0;
+                    }),
+                    std::runtime_error);
+  REQUIRE(q.size() == 31);
+  int last = q.top().first;
+  while (!q.empty())
+  {
+    REQUIRE(q.top().second);
+    REQUIRE(*q.top().second == q.top().first);
+    REQUIRE(q.top().first >= last);
+    last = q.top().first;
+    q.pop();
+  }
+}
+
+namespace {
+// Throws bad_alloc once *allocations have been made, or never if negative.
+template <typename T>
+struct limited_allocator
+{
+  using value_type = T;
+  explicit limited_allocator(int *allocations_) noexcept : allocations(allocations_) {}
+  template <typename U>
+  limited_allocator(limited_allocator<U> const &a) noexcept : allocations(a.allocations) {}
+  T *allocate(std::size_t n)
+  {
+    if (*allocations == 0) throw std::bad_alloc();
+    if (*allocations > 0) --*allocations;
+    return std::allocator<T>{}.allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) noexcept { std::allocator<T>{}.deallocate(p, n); }
+  int *allocations;
+};
+
+template <typename T, typename U>
+bool operator==(limited_allocator<T> const &l, limited_allocator<U> const &r)
+{
+  return l.allocations == r.allocations;
+}
+
+template <typename T, typename U>
+bool operator!=(limited_allocator<T> const &l, limited_allocator<U> const &r)
+{
+  return !(l == r);
+}
+}
+
+TEST_CASE("a split that runs out of memory keeps every element", "[erase]")
+{
+  int allocations = -1;
+  prio_queue<16, int, std::unique_ptr<int>, std::less<int>, limited_allocator<int>> q{
+    limited_allocator<int>(&allocations)};
+  for (int i = 0; i < 600; ++i) q.push((i * 7) % 600, std::make_unique<int>((i * 7) % 600));
+  // Enough for the first few hundred elements of the rest, but not all.
+  allocations = 2;
+  REQUIRE_THROWS_AS(q.split(10), std::bad_alloc);
+  allocations = -1;
+  REQUIRE(q.size() == 600);
+  for (int i = 0; i < 600; ++i)
+  {
+    REQUIRE(q.top().first == i);
+    REQUIRE(*q.top().second == i);
+    q.pop();
+  }
+}
+
+TEST_CASE("a throwing transform_keys leaves a heap", "[erase]")
+{
+  prio_queue<16, int, void> q;
+  for (int i = 0; i < 1000; ++i) q.push(i);
+  int calls = 0;
+  REQUIRE_THROWS_AS(q.transform_keys([&](int k) {
+                      if (++calls == 500) throw std::runtime_error("stop");
+                      return -k;
+                    }),
+                    std::runtime_error);
+  REQUIRE(q.size() == 1000);
+  int last = q.top();
+  while (!q.empty())
+  {
+    REQUIRE(q.top() >= last);
+    last = q.top();
+    q.pop();
+  }
+}
@@ -0,0 +1,103 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+// The prefetching sift down is only compiled when
+// ROLLBEAR_PRIO_QUEUE_PREFETCH_DISTANCE is defined before prio_queue.hpp is
+// included, so it is tested by a program of its own, next to self_test.
+
+#define ROLLBEAR_PRIO_QUEUE_PREFETCH_DISTANCE 1
+
+#include "prio_queue.hpp"
+#include "mmap_storage.hpp"
+#include <map>
+#include <random>
+#include <set>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+using rollbear::prio_queue;
+
+namespace {
+template <std::size_t block_size, std::size_t arity, typename Storage>
+void check_pop_and_reschedule_with_payloads()
+{
+  std::mt19937 gen(block_size * arity);
+  std::uniform_int_distribution<int> dist(0, 100000);
+  prio_queue<block_size, int, int, std::less<int>, std::allocator<int>, arity,
+             Storage> q;
+  std::multimap<int, int> reference;
+  for (int i = 0; i < 20000; ++i)
+  {
+    auto k = dist(gen);
+    q.push(k, -k);
+    reference.emplace(k, -k);
+  }
+  for (int i = 0; i < 5000; ++i)
+  {
+    auto k = dist(gen);
+    REQUIRE(q.top().first == reference.begin()->first);
+    q.top().second = -k;
+    q.reschedule_top(k);
+    reference.erase(reference.begin());
+    reference.emplace(k, -k);
+  }
+  for (auto &e : reference)
+  {
+    REQUIRE(q.top().first == e.first);
+    REQUIRE(q.top().second == e.second);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+template <std::size_t block_size, std::size_t arity, typename Storage>
+void check_pop_without_payloads()
+{
+  std::mt19937 gen(block_size + arity);
+  std::uniform_int_distribution<int> dist(0, 100000);
+  prio_queue<block_size, int, void, std::less<int>, std::allocator<int>, arity,
+             Storage> q;
+  std::multiset<int> reference;
+  for (int i = 0; i < 20000; ++i)
+  {
+    auto k = dist(gen);
+    q.push(k);
+    reference.insert(k);
+  }
+  for (auto k : reference)
+  {
+    REQUIRE(q.top() == k);
+    q.pop();
+  }
+  REQUIRE(q.empty());
+}
+
+template <typename Storage>
+void check_storage()
+{
+  check_pop_and_reschedule_with_payloads<8, 2, Storage>();
+  check_pop_and_reschedule_with_payloads<64, 8, Storage>();
+  check_pop_without_payloads<16, 2, Storage>();
+  check_pop_without_payloads<32, 4, Storage>();
+}
+}
+
+TEST_CASE("prefetching queues pop in order for every storage", "[prefetch]")
+{
+  check_storage<rollbear::contiguous_storage>();
+  check_storage<rollbear::segmented_storage<64>>();
+  check_storage<rollbear::block_interleaved_storage>();
+  check_storage<rollbear::line_interleaved_storage<>>();
+  check_storage<rollbear::mmap_storage>();
+}
@@ -0,0 +1,455 @@
+/*
+ * B-heap priority queue
+ *
+ * Copyright Björn Fahller 2015
+ *
+ *  Use, modification and distribution is subject to the
+ *  Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ *
+ * Project home: https://github.com/rollbear/prio_queue
+ */
+
+#ifndef ROLLBEAR_TIMER_QUEUE_HPP
+#define ROLLBEAR_TIMER_QUEUE_HPP
+
+#include "prio_queue.hpp"
+#include "radix_prio_queue.hpp"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+#include <cstdint>
+
+namespace rollbear
+{
+
+// A hierarchical timing wheel in front of a prio_queue<>, with the interface
+// of prio_queue<>, ordered by std::less<T>, for integral deadlines. Like
+// radix_prio_queue<>, it is for monotone use only: no deadline pushed may be
+// earlier than the last one popped, or before the first pop, earlier than
+// the start time given to the constructor. This is asserted in debug builds.
+//
+// The wheel has levels levels of 64 slots each, where slot s at level l holds
+// the deadlines that agree with the last popped deadline, "now", in all bits
+// above the lowest 6 * (l + 1), and have s in the 6 bits below. Deadlines
+// that differ from now above the lowest 6 * levels bits, the horizon, are
+// pushed on the prio_queue<> instead. A push() that lands in the wheel is an
+// append to a slot, regardless of the number of timers.
+//
+// The order is exact. The earliest deadline is in the first occupied slot of
+// the lowest occupied level, where a slot at level 0 only holds one deadline.
+// When the earliest deadline is popped from a slot at a higher level, the
+// rest of the slot is spread over the levels below, and when it is popped
+// from the prio_queue<>, the deadlines that then come within the horizon are
+// moved into the wheel.
+template <typename T, typename V, std::size_t levels = 4,
+          std::size_t block_size = 16>
+class timer_queue
+{
+  static_assert(std::is_integral<T>::value,
+                "timer_queue requires an integral deadline type");
+  using bits_type = std::make_unsigned_t<T>;
+  static constexpr std::size_t slot_bits = 6;
+  static constexpr std::size_t num_slots = std::size_t(1) << slot_bits;
+  static_assert(levels >= 1
+                && levels * slot_bits <= std::numeric_limits<bits_type>::digits,
+                "the wheel must have at least one level, and not more than the"
+                " bits of the deadline type");
+  using element = prio_q_internal::element<T, V>;
+  using slot = std::vector<typename element::type>;
+  using heap = prio_queue<block_size, T, V>;
+public:
+  using value_type = T;
+  using payload_type = V;
+
+  // Deadlines close after start are kept in the wheel from the beginning.
+  explicit timer_queue(T start = T()) noexcept;
+
+  template <typename U, typename X = V>
+  std::enable_if_t<std::is_same<X, void>::value>
+  push(U &&u);
+
+  template <typename U, typename X>
+  std::enable_if_t<!std::is_same<X, void>::value>
+  push(U &&key, X &&value);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, value_type const &>
+  top() const noexcept;
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+  top() noexcept;
+
+  void pop();
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value>
+  reschedule_top(T t);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value>
+  reschedule_top(T t);
+
+  bool empty() const noexcept;
+
+  std::size_t size() const noexcept;
+
+  // The number of timers in the wheel, as opposed to in the prio_queue<>.
+  std::size_t wheel_size() const noexcept;
+
+  void clear() noexcept;
+private:
+  template <typename E>
+  void insert(E &&e);
+
+  template <typename E>
+  void place(E &&e, std::size_t level);
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value>
+  to_heap(typename element::type &&e) { m_heap.push(std::move(e)); }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value>
+  to_heap(typename element::type &&e)
+  {
+    m_heap.push(std::move(e.first), std::move(e.second));
+  }
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, typename element::type>
+  from_heap() { return m_heap.top(); }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, typename element::type>
+  from_heap()
+  {
+    auto top = m_heap.top();
+    return { top.first, std::move(top.second) };
+  }
+
+  template <typename U = V>
+  std::enable_if_t<std::is_same<U, void>::value, T const &>
+  heap_top_key() noexcept { return m_heap.top(); }
+
+  template <typename U = V>
+  std::enable_if_t<!std::is_same<U, void>::value, T const &>
+  heap_top_key() noexcept { return m_heap.top().first; }
+
+  T const &top_key() noexcept;
+
+  std::size_t level_of(T t) const noexcept;
+
+  static std::size_t slot_of(T t, std::size_t level) noexcept;
+
+  void refill_from_heap();
+
+  void find_top() noexcept;
+
+  std::array<std::array<slot, num_slots>, levels> m_wheel;
+  std::array<std::uint64_t, levels>               m_occupied{};
+  heap                                            m_heap;
+  std::size_t                                     m_wheel_size = 0;
+  bits_type                                       m_start;
+  // The deadline last popped, or the start before the first pop.
+  bits_type                                       m_now;
+  // Where the earliest timer is, valid when not empty. A level of levels
+  // means the top of the prio_queue<>.
+  std::size_t                                     m_top_level = 0;
+  std::size_t                                     m_top_slot = 0;
+  std::size_t                                     m_top_idx = 0;
+};
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+timer_queue<T, V, levels, block_size>::
+timer_queue(T start)
+noexcept
+  : m_start(prio_q_internal::radix_bits(start))
+  , m_now(m_start)
+{
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename U, typename X>
+inline
+std::enable_if_t<std::is_same<X, void>::value>
+timer_queue<T, V, levels, block_size>::
+push(U &&u)
+{
+  insert(T(std::forward<U>(u)));
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename U, typename X>
+inline
+std::enable_if_t<!std::is_same<X, void>::value>
+timer_queue<T, V, levels, block_size>::
+push(U &&key, X &&value)
+{
+  insert(typename element::type(std::forward<U>(key), std::forward<X>(value)));
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value, T const &>
+timer_queue<T, V, levels, block_size>::
+top() const noexcept
+{
+  assert(!empty());
+  if (m_top_level == levels) return m_heap.top();
+  return m_wheel[m_top_level][m_top_slot][m_top_idx];
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value, std::pair<T const &, U &>>
+timer_queue<T, V, levels, block_size>::
+top() noexcept
+{
+  assert(!empty());
+  if (m_top_level == levels) return m_heap.top();
+  auto &e = m_wheel[m_top_level][m_top_slot][m_top_idx];
+  return { e.first, e.second };
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+void
+timer_queue<T, V, levels, block_size>::
+pop()
+{
+  assert(!empty());
+  if (m_top_level == levels)
+  {
+    // The wheel is empty, since everything in it is earlier than anything
+    // beyond the horizon.
+    m_now = prio_q_internal::radix_bits(heap_top_key());
+    m_heap.pop();
+    refill_from_heap();
+    find_top();
+    return;
+  }
+  auto &s = m_wheel[m_top_level][m_top_slot];
+  m_now = prio_q_internal::radix_bits(element::key(s[m_top_idx]));
+  if (m_top_idx != s.size() - 1)
+  {
+    s[m_top_idx] = std::move(s.back());
+  }
+  s.pop_back();
+  --m_wheel_size;
+  if (m_top_level != 0)
+  {
+    // The rest of the slot now agrees with now in all bits of this level,
+    // so it all goes to lower levels. The slot keeps its memory.
+    for (auto &e : s)
+    {
+      auto const level = level_of(element::key(e));
+      place(std::move(e), level);
+    }
+    m_wheel_size -= s.size();
+    s.clear();
+  }
+  if (s.empty())
+  {
+    m_occupied[m_top_level] &= ~(std::uint64_t(1) << m_top_slot);
+  }
+  find_top();
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename U>
+inline
+std::enable_if_t<!std::is_same<U, void>::value>
+timer_queue<T, V, levels, block_size>::
+reschedule_top(T t)
+{
+  auto value = std::move(top().second);
+  pop();
+  push(std::move(t), std::move(value));
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename U>
+inline
+std::enable_if_t<std::is_same<U, void>::value>
+timer_queue<T, V, levels, block_size>::
+reschedule_top(T t)
+{
+  pop();
+  push(std::move(t));
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+bool
+timer_queue<T, V, levels, block_size>::
+empty()
+const
+noexcept
+{
+  return size() == 0;
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+std::size_t
+timer_queue<T, V, levels, block_size>::
+size()
+const
+noexcept
+{
+  return m_wheel_size + m_heap.size();
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+std::size_t
+timer_queue<T, V, levels, block_size>::
+wheel_size()
+const
+noexcept
+{
+  return m_wheel_size;
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+void
+timer_queue<T, V, levels, block_size>::
+clear()
+noexcept
+{
+  for (auto &level : m_wheel)
+  {
+    for (auto &s : level) s.clear();
+  }
+  m_occupied.fill(0);
+  m_heap.clear();
+  m_wheel_size = 0;
+  m_now = m_start;
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename E>
+inline
+void
+timer_queue<T, V, levels, block_size>::
+insert(E &&e)
+{
+  auto const key = element::key(e);
+  assert(!(prio_q_internal::radix_bits(key) < m_now)
+         && "timer_queue deadlines must not decrease");
+  bool const is_top = empty() || key < top_key();
+  auto const level = level_of(key);
+  if (level == levels)
+  {
+    to_heap(std::forward<E>(e));
+    if (is_top) m_top_level = levels;
+    return;
+  }
+  place(std::forward<E>(e), level);
+  if (is_top)
+  {
+    m_top_level = level;
+    m_top_slot = slot_of(key, level);
+    m_top_idx = m_wheel[level][m_top_slot].size() - 1;
+  }
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+template <typename E>
+inline
+void
+timer_queue<T, V, levels, block_size>::
+place(E &&e, std::size_t level)
+{
+  auto const s = slot_of(element::key(e), level);
+  m_wheel[level][s].push_back(std::forward<E>(e));
+  m_occupied[level] |= std::uint64_t(1) << s;
+  ++m_wheel_size;
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+T const &
+timer_queue<T, V, levels, block_size>::
+top_key()
+noexcept
+{
+  if (m_top_level == levels) return heap_top_key();
+  return element::key(m_wheel[m_top_level][m_top_slot][m_top_idx]);
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+std::size_t
+timer_queue<T, V, levels, block_size>::
+level_of(T t)
+const
+noexcept
+{
+  auto const width = prio_q_internal::bit_width(prio_q_internal::radix_bits(t)
+                                                ^ m_now);
+  return width == 0 ? 0 : std::min((width - 1) / slot_bits, levels);
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+inline
+std::size_t
+timer_queue<T, V, levels, block_size>::
+slot_of(T t, std::size_t level)
+noexcept
+{
+  return (prio_q_internal::radix_bits(t) >> (slot_bits * level))
+         & (num_slots - 1);
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+void
+timer_queue<T, V, levels, block_size>::
+refill_from_heap()
+{
+  while (!m_heap.empty())
+  {
+    auto const level = level_of(heap_top_key());
+    if (level == levels) return;
+    place(from_heap(), level);
+    m_heap.pop();
+  }
+}
+
+template <typename T, typename V, std::size_t levels, std::size_t block_size>
+void
+timer_queue<T, V, levels, block_size>::
+find_top()
+noexcept
+{
+  for (std::size_t level = 0; level != levels; ++level)
+  {
+    if (!m_occupied[level]) continue;
+    auto const s = prio_q_internal::lowest_bit(m_occupied[level]);
+    auto const &elements = m_wheel[level][s];
+    std::size_t idx = elements.size() - 1;
+    if (level != 0)
+    {
+      for (std::size_t i = 0; i != elements.size(); ++i)
+      {
+        if (element::key(elements[i]) < element::key(elements[idx])) idx = i;
+      }
+    }
+    m_top_level = level;
+    m_top_slot = s;
+    m_top_idx = idx;
+    return;
+  }
+  m_top_level = levels;
+}
+
+} // namespace rollbear
+
+#endif //ROLLBEAR_TIMER_QUEUE_HPP